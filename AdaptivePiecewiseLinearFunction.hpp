@@ -0,0 +1,348 @@
+#ifndef ADAPTIVE_PIECEWISE_LINEAR_FUNCTION_HPP
+#define ADAPTIVE_PIECEWISE_LINEAR_FUNCTION_HPP
+
+// A piecewise-linear inverse CDF on non-uniform bins.
+//
+// PiecewiseLinearFunction puts its knots at the uniform bin edges n / N_BINS,
+// so a function that only bends sharply in a few places needs many bins
+// everywhere.  Here the bin edges are free, and refine() places them where
+// linear interpolation of a given function is worst, which gives the same
+// accuracy with far fewer bins.
+// -- N_BINS must be a power of two.  The N_BINS-1 interior edges then form a
+//    complete binary search tree, stored in Eytzinger (breadth-first) order,
+//    and finding the bin of x takes exactly log2(N_BINS) steps with no
+//    branches: k = 2k + (edge[k] <= x).  The bits of the leaf reached are the
+//    bin index.
+// -- Evaluation is otherwise that of PiecewiseLinearFunction (y = m x + b per
+//    bin, multiply then add).  The search costs log2(N_BINS) dependent loads
+//    where the uniform bins take one multiply, so the gain is in the number
+//    of bins (table size, and samples to fit them), not in time per value.
+// -- The function passes through (0,0) and (1,1).
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// Bin lookup
+
+namespace adaptive_piecewise_linear_function_ {
+
+// Steps down the tree from node k, LEVELS times (written out by recursion,
+// so there is no loop to branch on)
+template <typename Float, std::size_t LEVELS>
+inline __attribute__((always_inline))
+std::uint32_t descend(Float const * __restrict edges, Float const x,
+        std::uint32_t const k) {
+    if constexpr (LEVELS == 0) {
+        return k;
+    } else {
+        return descend<Float, LEVELS-1>(edges, x,
+                2 * k + std::uint32_t(edges[k] <= x));
+    }
+}
+
+constexpr std::size_t log2(std::size_t const n) {
+    return n <= 1 ? 0 : 1 + log2(n / 2);
+}
+
+// Bin of x, given the interior edges in Eytzinger order at edges[1..N_BINS)
+template <typename Float, std::size_t N_BINS>
+inline __attribute__((always_inline))
+std::uint32_t find_bin(Float const * __restrict edges, Float const x) {
+    return descend<Float, log2(N_BINS)>(edges, x, 1)
+        - std::uint32_t(N_BINS);
+}
+
+} // end namespace adaptive_piecewise_linear_function_
+
+// ============================================================================
+
+template <typename Float, std::size_t N_BINS>
+class AdaptivePiecewiseLinearFunction {
+
+    static_assert(N_BINS >= 1 && (N_BINS & (N_BINS - 1)) == 0,
+            "N_BINS must be a power of two");
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    // Interior bin edges in Eytzinger order at [1, N_BINS) ([0] is unused)
+    std::array<Float, N_BINS> tree_;
+
+    // Bin edges and function values there, in order, including (0,0) and
+    // (1,1)
+    std::array<Float, N_BINS+1> edges_;
+    std::array<Float, N_BINS+1> knots_;
+
+    // Coefficients (y = m x + b)
+    std::array<Float, N_BINS> slopes_;
+    std::array<Float, N_BINS> intercepts_;
+
+    // ------------------------------------------------------------------------
+
+    // Lays out edges_[1..N_BINS) in the subtree under node k, in order
+    std::size_t build_tree_(std::size_t const k, std::size_t next) {
+        if (k < N_BINS) {
+            next = build_tree_(2 * k, next);
+            tree_[k] = edges_[next++];
+            next = build_tree_(2 * k + 1, next);
+        }
+        return next;
+    }
+
+    void construct_coefficients_() {
+        assert(edges_.front() == 0 && edges_.back() == 1);
+        assert(knots_.front() == 0 && knots_.back() == 1);
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            assert(edges_[n] < edges_[n+1]);
+            assert(knots_[n] <= knots_[n+1]);
+            Float m = (knots_[n+1] - knots_[n]) / (edges_[n+1] - edges_[n]);
+            slopes_[n] = m;
+            intercepts_[n] = knots_[n+1] - m * edges_[n+1];
+        }
+        tree_[0] = Float{0};
+        build_tree_(1, 1);
+    }
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Default-constructs the object (mostly for testing).
+    AdaptivePiecewiseLinearFunction() = default;
+
+    // Takes the interior bin edges (increasing, within (0,1)) and the
+    // function values there
+    // -- Implies the points (0,0) and (1,1).
+    AdaptivePiecewiseLinearFunction(std::array<Float, N_BINS-1> const & edges,
+            std::array<Float, N_BINS-1> const & points) {
+        edges_.front() = Float{0};
+        knots_.front() = Float{0};
+        for (std::size_t n = 0; n < N_BINS-1; n++) {
+            edges_[n+1] = edges[n];
+            knots_[n+1] = points[n];
+        }
+        edges_.back() = Float{1};
+        knots_.back() = Float{1};
+        construct_coefficients_();
+    }
+
+    // ------------------------------------------------------------------------
+    // Adaptive refinement
+
+private:
+
+    // Largest deviation of f from the line through (lo, f_lo) and (hi, f_hi)
+    // at n_probes-1 evenly spaced points between them
+    template <typename Function>
+    static Float bin_error_(Function const & f, Float const lo,
+            Float const hi, Float const f_lo, Float const f_hi,
+            std::size_t const n_probes) {
+        Float error{0};
+        for (std::size_t j = 1; j < n_probes; j++) {
+            Float w = Float(j) / Float(n_probes);
+            Float line = f_lo + w * (f_hi - f_lo);
+            error = std::max(error,
+                    Float(std::abs(Float(f(lo + w * (hi - lo))) - line)));
+        }
+        return error;
+    }
+
+public:
+
+    // Bins f where linear interpolation of it is worst, in two steps:
+    // -- Bisection: starting from [0,1), the bin with the largest error is
+    //    split in half until there are N_BINS.
+    // -- Equidistribution, n_passes times: interpolating over a bin of width
+    //    h is off by about |f''| h^2 / 8, so the edges are moved to give each
+    //    bin an equal share of the integral of |f''|^(1/2) (estimated from
+    //    the errors of the current bins), which evens the errors out.  The
+    //    edges with the smallest largest error are kept.
+    // Errors are measured at n_probes-1 points inside each bin.
+    // -- f is only called inside (0,1), so a tabulated function (e.g. a
+    //    fine PiecewiseLinearFunction) can be re-binned too.
+    // -- f must not decrease; (0,0) and (1,1) are implied.
+    template <typename Function>
+    static AdaptivePiecewiseLinearFunction refine(Function const & f,
+            std::size_t const n_probes = 8, std::size_t const n_passes = 4) {
+        struct Bin {
+            Float lo, hi, f_lo, f_hi, error;
+            bool operator<(Bin const & other) const {
+                return error < other.error;
+            }
+        };
+        // (a bin too narrow to halve is never split again)
+        auto make_bin = [&](Float lo, Float hi, Float f_lo, Float f_hi) {
+            Float mid = Float{0.5} * (lo + hi);
+            Float error = bin_error_(f, lo, hi, f_lo, f_hi, n_probes);
+            return Bin{lo, hi, f_lo, f_hi,
+                lo < mid && mid < hi ? error : Float{-1}};
+        };
+
+        std::priority_queue<Bin> queue;
+        queue.push(make_bin(Float{0}, Float{1}, Float{0}, Float{1}));
+        while (queue.size() < N_BINS) {
+            Bin bin = queue.top();
+            queue.pop();
+            Float mid = Float{0.5} * (bin.lo + bin.hi);
+            Float f_mid = Float(f(mid));
+            queue.push(make_bin(bin.lo, mid, bin.f_lo, f_mid));
+            queue.push(make_bin(mid, bin.hi, f_mid, bin.f_hi));
+        }
+        std::vector<Bin> bins;
+        while (!queue.empty()) {
+            bins.push_back(queue.top());
+            bins.back().error = bin_error_(f, bins.back().lo, bins.back().hi,
+                    bins.back().f_lo, bins.back().f_hi, n_probes);
+            queue.pop();
+        }
+        std::sort(bins.begin(), bins.end(), [](Bin const & a, Bin const & b) {
+            return a.lo < b.lo;
+        });
+
+        auto largest_error = [](std::vector<Bin> const & bins) {
+            Float error{0};
+            for (auto const & bin : bins) {
+                error = std::max(error, bin.error);
+            }
+            return error;
+        };
+        std::vector<Bin> best = bins;
+        Float best_error = largest_error(bins);
+        for (std::size_t pass = 0; pass < n_passes && best_error > 0; pass++) {
+            // Share of each bin, with a floor so that bins where f is
+            // straight keep some width (summed in double: with float and
+            // many bins the shares vanish against the running total)
+            std::vector<double> cumulative(N_BINS + 1, 0.0);
+            double total = 0;
+            for (auto const & bin : bins) {
+                total += std::sqrt(double(bin.error));
+            }
+            double floor = 1e-3 * total / double(N_BINS);
+            for (std::size_t n = 0; n < N_BINS; n++) {
+                cumulative[n+1] = cumulative[n]
+                    + std::sqrt(double(bins[n].error)) + floor;
+            }
+            // Edges at equal steps of the (piecewise-linear) cumulative share
+            std::vector<Float> edges(N_BINS + 1);
+            edges.front() = Float{0};
+            edges.back() = Float{1};
+            std::size_t b = 0;
+            for (std::size_t k = 1; k < N_BINS; k++) {
+                double target = double(k) * cumulative[N_BINS] / double(N_BINS);
+                while (b + 1 < N_BINS && cumulative[b+1] <= target) {
+                    b++;
+                }
+                double w = (target - cumulative[b])
+                    / (cumulative[b+1] - cumulative[b]);
+                edges[k] = Float(double(bins[b].lo)
+                        + w * double(bins[b].hi - bins[b].lo));
+            }
+            // (rounding may leave neighbors equal; such a pass is dropped)
+            bool increasing = true;
+            for (std::size_t k = 0; k < N_BINS; k++) {
+                increasing = increasing && edges[k] < edges[k+1];
+            }
+            if (!increasing) {
+                break;
+            }
+            std::vector<Float> values(N_BINS + 1);
+            values.front() = Float{0};
+            values.back() = Float{1};
+            for (std::size_t k = 1; k < N_BINS; k++) {
+                values[k] = Float(f(edges[k]));
+            }
+            for (std::size_t n = 0; n < N_BINS; n++) {
+                bins[n] = Bin{edges[n], edges[n+1], values[n], values[n+1],
+                    bin_error_(f, edges[n], edges[n+1], values[n],
+                            values[n+1], n_probes)};
+            }
+            Float error = largest_error(bins);
+            if (error < best_error) {
+                best = bins;
+                best_error = error;
+            }
+        }
+
+        std::array<Float, N_BINS-1> edges;
+        std::array<Float, N_BINS-1> points;
+        // (f rounded in floating point may step down by an ulp)
+        Float previous{0};
+        for (std::size_t n = 0; n < N_BINS-1; n++) {
+            edges[n] = best[n+1].lo;
+            points[n] = std::min(std::max(best[n+1].f_lo, previous), Float{1});
+            previous = points[n];
+        }
+        return AdaptivePiecewiseLinearFunction(edges, points);
+    }
+
+    // Largest deviation from f at the centers of n_points equal intervals of
+    // [0,1) (a check of how well the bins fit f)
+    template <typename Function>
+    Float max_error(Function const & f,
+            std::size_t const n_points = std::size_t(1) << 16) const {
+        Float error{0};
+        for (std::size_t n = 0; n < n_points; n++) {
+            Float x = (Float(n) + Float{0.5}) / Float(n_points);
+            error = std::max(error, Float(std::abs((*this)(x) - Float(f(x)))));
+        }
+        return error;
+    }
+
+    // ------------------------------------------------------------------------
+    // Get the bin edges and the function values there, including (0,0) and
+    // (1,1)
+
+public:
+
+    auto const & get_bin_edges() const {
+        return edges_;
+    }
+
+    auto const & get_knots() const {
+        return knots_;
+    }
+
+    // ------------------------------------------------------------------------
+    // Call operator to evaluate function
+
+public:
+
+    auto operator() (Float const & x) const {
+        assert(x >= Float{0});
+        assert(x <  Float{1});
+        std::uint32_t index = adaptive_piecewise_linear_function_::find_bin<
+            Float, N_BINS>(tree_.data(), x);
+        auto const & m = slopes_[index];
+        auto const & b = intercepts_[index];
+        return m * x + b;
+    }
+
+    // Evaluates the function at in[0..n) and writes the results to out[0..n)
+    // -- Identical to calling operator() on each point.
+    // -- All inputs must be in [0,1).
+    // -- in and out must not overlap.
+    // -- Kept scalar: vectorized, every level of the search is a gather that
+    //    waits on the one before, which measured slower than scalar loads
+    //    the CPU overlaps across values.
+    __attribute__((optimize("no-tree-vectorize")))
+    void evaluate(Float const * __restrict in, Float * __restrict out,
+            std::size_t const n) const {
+        for (std::size_t i = 0; i < n; i++) {
+            out[i] = (*this)(in[i]);
+        }
+    }
+
+};
+
+#endif // ADAPTIVE_PIECEWISE_LINEAR_FUNCTION_HPP
@@ -1,8 +1,220 @@
 #ifndef BINNED_PDF_HPP
 #define BINNED_PDF_HPP
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// ============================================================================
+// Running statistics of the counts, for the error against a uniform PDF
+// (shared with DynamicBinnedPDF)
+// -- sum_sq (sum of squared counts) and max are updated on every deposit.
+//    sum_sq is exact (128-bit for integral counters), so the chi-square
+//    N sum_sq / count - count does not lose the small difference of two
+//    large numbers.
+// -- min is the smallest count and n_at_min the number of bins holding it.
+//    Once all of those bins have grown, min is rescanned when next asked for.
+//    min can only grow count / N_BINS times, so the rescans are O(1) per
+//    deposit amortized.
+// -- stale means the counts changed without the statistics (atomic or
+//    compact deposits, merges); they are recomputed in one pass when next
+//    asked for.
+// -- Weights added to a bin are assumed non-negative.
+
+namespace binned_pdf_ {
+
+template <typename Integer>
+struct Statistics {
+
+    using Wide = typename std::conditional<std::is_integral<Integer>::value,
+        unsigned __int128, long double>::type;
+
+    Wide sum_sq{0};
+    Integer max{0};
+    Integer min{0};
+    std::size_t n_at_min{0};
+    bool min_stale{false};
+    bool stale{false};
+
+    void clear(std::size_t const n_bins) {
+        sum_sq = 0;
+        max = Integer{0};
+        min = Integer{0};
+        n_at_min = n_bins;
+        min_stale = false;
+        stale = false;
+    }
+
+    // A bin going from c to c + w
+    void add(Integer const c, Integer const w) {
+        sum_sq += Wide(2) * Wide(c) * Wide(w) + Wide(w) * Wide(w);
+        max = std::max(max, Integer(c + w));
+        if (c == min && !min_stale && --n_at_min == 0) {
+            min_stale = true;
+        }
+    }
+
+    // Brings the statistics up to date with the counts c[0..n_bins)
+    void update(Integer const * c, std::size_t const n_bins) {
+        if (n_bins == 0) {
+            return;
+        }
+        if (stale) {
+            sum_sq = 0;
+            max = c[0];
+            for (std::size_t n = 0; n < n_bins; n++) {
+                sum_sq += Wide(c[n]) * Wide(c[n]);
+                max = std::max(max, c[n]);
+            }
+        }
+        if (stale || min_stale) {
+            min = *std::min_element(c, c + n_bins);
+            n_at_min = std::size_t(std::count(c, c + n_bins, min));
+        }
+        stale = false;
+        min_stale = false;
+    }
+
+    // sum over bins of (c - E)^2 / E, with E = count / n_bins
+    double chi_square(Integer const count, std::size_t const n_bins) const {
+        if (count == Integer{0}) {
+            return 0.0;
+        }
+        Wide num = Wide(n_bins) * sum_sq - Wide(count) * Wide(count);
+        return double(num) / double(count);
+    }
+
+};
+
+} // end namespace binned_pdf_
+
+// ============================================================================
+// Batched deposits (shared with DynamicBinnedPDF)
+//
+// A deposit is a random increment into the histogram, so once the counters no
+// longer fit in L2 every deposit is a cache miss.  deposit_batch() avoids
+// this for large histograms in two ways:
+// -- Each bin gets a one-byte compact counter next to its wide counter; a
+//    deposit increments the compact counter, and when it wraps the wide
+//    counter gets 256.  The compact counters of 2^20 bins fit in L2, where the
+//    wide counters (4-8 bytes each) would not.  The compact counters are
+//    folded into the wide counters (flush) before the counts are read.
+// -- Histograms with more bins than that are split into blocks of 2^20 bins.
+//    A batch of samples is first partitioned by block (one counting-sort
+//    pass), then counted one block at a time, so the counters being
+//    incremented stay in L2 for the length of the batch.
+// Small histograms are counted directly: their wide counters already stay in
+// cache, and the compact counters would only add work.
+
+namespace binned_pdf_ {
+
+// Fewer bins than this are counted directly
+constexpr std::size_t COMPACT_BINS = std::size_t(1) << 17;
+
+// Bins per block of the partition
+constexpr unsigned BLOCK_SHIFT = 20;
+
+// Counts the bins index[0..n) in the compact counters
+template <typename Integer>
+inline void count_compact(std::uint32_t const * __restrict index,
+        std::size_t const n, std::uint8_t * __restrict compact,
+        Integer * __restrict wide) {
+    for (std::size_t i = 0; i < n; i++) {
+        std::uint32_t b = index[i];
+        if (++compact[b] == 0) {
+            wide[b] += Integer(256);
+        }
+    }
+}
+
+// Deposits x[0..n) into a histogram of n_bins bins
+// -- Direct deposits update stats; compact ones leave that to the caller.
+// -- compact must hold n_bins zero-initialized (or pending) counters when
+//    n_bins >= COMPACT_BINS; it is not touched otherwise.
+// -- Returns true if there are compact counts to flush.
+template <typename Float, typename Integer>
+bool deposit_batch(Float const * x, std::size_t const n,
+        std::size_t const n_bins, std::uint8_t * compact, Integer * wide,
+        Statistics<Integer> & stats) {
+    Float scale = Float(n_bins);
+    if (n_bins < COMPACT_BINS) {
+        // Local copy, so the statistics stay in registers (wide may alias
+        // them as far as the compiler knows)
+        Statistics<Integer> local = stats;
+        for (std::size_t i = 0; i < n; i++) {
+            assert(x[i] >= Float{0});
+            assert(x[i] < Float{1});
+            auto & c = wide[std::size_t(x[i] * scale)];
+            local.add(c, Integer{1});
+            c++;
+        }
+        stats = local;
+        return false;
+    }
+    assert(n_bins <= (std::size_t(1) << 32));
+    thread_local std::vector<std::uint32_t> index;
+    thread_local std::vector<std::uint32_t> sorted;
+    thread_local std::vector<std::size_t> offsets;
+    index.resize(n);
+    for (std::size_t i = 0; i < n; i++) {
+        assert(x[i] >= Float{0});
+        assert(x[i] < Float{1});
+        index[i] = std::uint32_t(x[i] * scale);
+    }
+    std::size_t n_blocks = ((n_bins - 1) >> BLOCK_SHIFT) + 1;
+    if (n_blocks == 1) {
+        count_compact(index.data(), n, compact, wide);
+        return true;
+    }
+    // Partition by block (counting sort on the high bits)
+    offsets.assign(n_blocks + 1, 0);
+    for (std::size_t i = 0; i < n; i++) {
+        offsets[(index[i] >> BLOCK_SHIFT) + 1]++;
+    }
+    for (std::size_t b = 0; b < n_blocks; b++) {
+        offsets[b+1] += offsets[b];
+    }
+    sorted.resize(n);
+    for (std::size_t i = 0; i < n; i++) {
+        sorted[offsets[index[i] >> BLOCK_SHIFT]++] = index[i];
+    }
+    // In block order, so the counters in use move through one block at a time
+    count_compact(sorted.data(), n, compact, wide);
+    return true;
+}
+
+// Deposits x[0..n) with relaxed atomic increments (any number of threads
+// may deposit into the same counters at once)
+template <typename Float, typename Integer>
+void deposit_atomic(Float const * x, std::size_t const n,
+        std::size_t const n_bins, Integer * wide) {
+    static_assert(std::is_integral<Integer>::value,
+            "atomic deposits need an integral counter type");
+    Float scale = Float(n_bins);
+    for (std::size_t i = 0; i < n; i++) {
+        assert(x[i] >= Float{0});
+        assert(x[i] < Float{1});
+        __atomic_fetch_add(&wide[std::size_t(x[i] * scale)], Integer{1},
+                __ATOMIC_RELAXED);
+    }
+}
+
+// Adds the compact counters into the wide counters and zeroes them
+template <typename Integer>
+void flush(std::uint8_t * __restrict compact, Integer * __restrict wide,
+        std::size_t const n_bins) {
+    for (std::size_t n = 0; n < n_bins; n++) {
+        wide[n] += Integer(compact[n]);
+        compact[n] = 0;
+    }
+}
+
+} // end namespace binned_pdf_
 
 // ============================================================================
 
@@ -14,12 +226,45 @@ class BinnedPDF {
 
 private:
 
-    // PDF of output distribution
-    std::array<Integer, N_BINS> pdf_;
+    // PDF of output distribution (mutable for flush_)
+    mutable std::array<Integer, N_BINS> pdf_;
 
     // Count
     Integer count_;
 
+    // Compact counters of deposit_batch() (allocated on first use, only for
+    // large N_BINS) and whether they hold counts not yet in pdf_
+    mutable std::vector<std::uint8_t> compact_;
+    mutable bool pending_{false};
+
+    // Uniformity statistics (see binned_pdf_::Statistics)
+    mutable binned_pdf_::Statistics<Integer> stats_;
+
+    // Sums over the batches of add_batch(), for get_bin_variance() (empty
+    // until the first batch): per bin, of c^2 and c m, where c is the bin's
+    // count in a batch and m the batch's count; and of m^2 and m.
+    std::vector<double> batch_cc_;
+    std::vector<double> batch_cm_;
+    double batch_mm_{0};
+    double batch_m_{0};
+    std::size_t n_batches_{0};
+
+    // ------------------------------------------------------------------------
+
+    // Folds pending compact counts into pdf_ (before the counts are read)
+    void flush_() const {
+        if (pending_) {
+            binned_pdf_::flush(compact_.data(), pdf_.data(), N_BINS);
+            pending_ = false;
+        }
+    }
+
+    auto const & statistics_() const {
+        flush_();
+        stats_.update(pdf_.data(), N_BINS);
+        return stats_;
+    }
+
     // ------------------------------------------------------------------------
     // Constructors
 
@@ -40,10 +285,94 @@ public:
         assert(x >= Float{0});
         assert(x < Float{1});
         std::size_t index = std::size_t(x * N_BINS);
+        stats_.add(pdf_[index], Integer{1});
         pdf_[index]++;
         count_++;
     }
 
+    // Add a weight directly to a bin (e.g. a probability mass computed
+    // without sampling, with a floating-point Integer type).
+    void add_to_bin(std::size_t const & index, Integer const & weight) {
+        assert(index < N_BINS);
+        stats_.add(pdf_[index], weight);
+        pdf_[index] += weight;
+        count_ += weight;
+    }
+
+    // Deposits x[0..n); same counts as calling deposit() on each value, but
+    // much faster for large N_BINS (see binned_pdf_ above).
+    void deposit_batch(Float const * x, std::size_t const n) {
+        if (N_BINS >= binned_pdf_::COMPACT_BINS && compact_.empty()) {
+            compact_.assign(N_BINS, 0);
+        }
+        if (binned_pdf_::deposit_batch(x, n, N_BINS, compact_.data(),
+                    pdf_.data(), stats_)) {
+            pending_ = true;
+            stats_.stale = true;
+        }
+        count_ += Integer(n);
+    }
+
+    // Deposits x[0..n) with relaxed atomic increments, so that several
+    // threads can deposit into this PDF at once (see AtomicHistogram).
+    // -- Nothing else may use the PDF while they do.
+    void deposit_batch_atomic(Float const * x, std::size_t const n) {
+        binned_pdf_::deposit_atomic(x, n, N_BINS, pdf_.data());
+        __atomic_fetch_add(&count_, Integer(n), __ATOMIC_RELAXED);
+        __atomic_store_n(&stats_.stale, true, __ATOMIC_RELAXED);
+    }
+
+    // ------------------------------------------------------------------------
+    // Merge another PDF into this one
+
+public:
+
+    // Adds the counts of another PDF (e.g. a partial PDF built by a worker
+    // thread) to this one.
+    BinnedPDF & operator+=(BinnedPDF const & other) {
+        other.flush_();
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            pdf_[n] += other.pdf_[n];
+        }
+        count_ += other.count_;
+        stats_.stale = true;
+        if (other.n_batches_ > 0) {
+            if (batch_cc_.empty()) {
+                batch_cc_.assign(N_BINS, 0.0);
+                batch_cm_.assign(N_BINS, 0.0);
+            }
+            for (std::size_t n = 0; n < N_BINS; n++) {
+                batch_cc_[n] += other.batch_cc_[n];
+                batch_cm_[n] += other.batch_cm_[n];
+            }
+            batch_mm_ += other.batch_mm_;
+            batch_m_ += other.batch_m_;
+            n_batches_ += other.n_batches_;
+        }
+        return *this;
+    }
+
+    // Adds the counts of an independent batch of samples (e.g. one chunk of
+    // a run) and keeps the sums get_bin_variance() needs.
+    void add_batch(BinnedPDF const & batch) {
+        assert(batch.n_batches_ == 0);
+        batch.flush_();
+        if (batch_cc_.empty()) {
+            batch_cc_.assign(N_BINS, 0.0);
+            batch_cm_.assign(N_BINS, 0.0);
+        }
+        double m = double(batch.count_);
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            double c = double(batch.pdf_[n]);
+            batch_cc_[n] += c * c;
+            batch_cm_[n] += c * m;
+        }
+        batch_mm_ += m * m;
+        batch_m_ += m;
+        n_batches_++;
+        *this += batch;
+    }
+
     // ------------------------------------------------------------------------
     // Clear the PDF
 
@@ -53,7 +382,17 @@ public:
         for (auto & x : pdf_) {
             x = Integer{0};
         }
+        if (pending_) {
+            std::fill(compact_.begin(), compact_.end(), std::uint8_t{0});
+            pending_ = false;
+        }
+        stats_.clear(N_BINS);
         count_ = 0;
+        batch_cc_.clear();
+        batch_cm_.clear();
+        batch_mm_ = 0;
+        batch_m_ = 0;
+        n_batches_ = 0;
     }
 
     // ------------------------------------------------------------------------
@@ -65,12 +404,110 @@ public:
         return count_;
     }
 
+    // ------------------------------------------------------------------------
+    // How many bins are there?
+
+public:
+
+    static constexpr std::size_t n_bins() {
+        return N_BINS;
+    }
+
+    // ------------------------------------------------------------------------
+    // Uniformity statistics
+    // -- Kept up to date as values are deposited, so these are O(1) (see
+    //    binned_pdf_::Statistics), except after batches that went through
+    //    the compact counters, atomic deposits or a merge, which cost one
+    //    pass over the bins.
+
+public:
+
+    // Sum over bins of count^2
+    Float sum_of_squares() const {
+        return Float(statistics_().sum_sq);
+    }
+
+    Integer min_count() const {
+        return statistics_().min;
+    }
+
+    Integer max_count() const {
+        return statistics_().max;
+    }
+
+    // Pearson chi-square against the uniform PDF: sum over bins of
+    // (c - E)^2 / E, with E = count / N_BINS
+    Float chi_square() const {
+        return Float(statistics_().chi_square(count_, N_BINS));
+    }
+
+    // Root-mean-square over bins of (p_n N_BINS - 1)
+    Float rms_deviation() const {
+        if (count_ == Integer{0}) {
+            return Float{0};
+        }
+        return std::sqrt(chi_square() / Float(count_));
+    }
+
+    // Largest |p_n N_BINS - 1|
+    Float max_deviation() const {
+        if (count_ == Integer{0}) {
+            return Float{0};
+        }
+        auto const & stats = statistics_();
+        Float expected = Float(count_) / Float(N_BINS);
+        return std::max(Float(stats.max) - expected,
+                expected - Float(stats.min)) / expected;
+    }
+
+    // ------------------------------------------------------------------------
+    // Variance of the bin counts
+    // -- With at least two batches making up every count (see add_batch),
+    //    from the spread of the batches: the ratio estimator
+    //        K / (K - 1) sum_k (c_k - p m_k)^2,  p = C / count,
+    //    over K batches of m_k deposits with c_k in the bin, which allows
+    //    batches of different sizes and holds for correlated samples (the
+    //    variance-reduction modes of ProbabilitySampler).
+    // -- Otherwise as for independent deposits: C (1 - C / count).
+
+public:
+
+    std::size_t n_batches() const {
+        return n_batches_;
+    }
+
+    Float get_bin_variance(std::size_t const & index) const {
+        assert(index < N_BINS);
+        flush_();
+        if (count_ == Integer{0}) {
+            return Float{0};
+        }
+        double c = double(pdf_[index]);
+        double p = c / double(count_);
+        if (n_batches_ < 2 || batch_m_ != double(count_)) {
+            return Float(c * (1.0 - p));
+        }
+        double K = double(n_batches_);
+        double ss = batch_cc_[index] - 2.0 * p * batch_cm_[index]
+            + p * p * batch_mm_;
+        return Float(std::max(0.0, ss) * K / (K - 1.0));
+    }
+
+    auto get_all_bin_variances() const {
+        std::array<Float, N_BINS> variances;
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            variances[n] = get_bin_variance(n);
+        }
+        return variances;
+    }
+
     // ------------------------------------------------------------------------
     // Get the PDF
 
 public:
 
-    auto get_pdf() {
+    auto get_pdf() const {
+        flush_();
         std::array<Float, N_BINS> pdf_norm;
         Float denom = Float{1} / Float(count_);
         for (int n = 0; n < N_BINS; n++) {
@@ -84,7 +521,8 @@ public:
 
 public:
 
-    auto get_all_bins() {
+    auto const & get_all_bins() const {
+        flush_();
         return pdf_;
     }
 
@@ -93,9 +531,10 @@ public:
 
 public:
 
-    auto get_bin(std::size_t const & index) {
+    auto get_bin(std::size_t const & index) const {
         assert(index >= 0);
         assert(index < N_BINS);
+        flush_();
         return pdf_[index];
     }
 
@@ -104,7 +543,7 @@ public:
 
 public:
 
-    auto get_bin_edges() {
+    auto get_bin_edges() const {
         std::array<Float, N_BINS+1> edges;
         for (int n = 0; n <= N_BINS; n++) {
             edges[n] = Float(n) / Float(N_BINS);
@@ -117,7 +556,7 @@ public:
 
 public:
 
-    auto get_bin_centers() {
+    auto get_bin_centers() const {
         std::array<Float, N_BINS> centers;
         for (int n = 0; n < N_BINS; n++) {
             centers[n] = (Float(n) + Float{0.5}) / Float(N_BINS);
@@ -0,0 +1,86 @@
+#ifndef CPU_DISPATCH_HPP
+#define CPU_DISPATCH_HPP
+
+// Run-time selection of SIMD kernels.
+//
+// A kernel is a struct with a static, always-inline run() holding the loop.
+// get_kernel<Kernel>() returns run() compiled for AVX-512, AVX2 or the
+// baseline instruction set, whichever is the best the CPU supports (picked
+// the first time it is needed).
+// -- The same loop is compiled for every target, so all of them give
+//    identical results as long as the arithmetic is the same.  The AVX-512
+//    target implies FMA, so contraction is switched off for the kernels; they
+//    are only called through a pointer, so this never gets in the way of
+//    inlining.
+// -- Off x86 (or off GCC-compatible compilers) only the baseline kernel is
+//    built.
+
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_DISPATCH 1
+#else
+#define CPU_DISPATCH 0
+#endif
+
+// ============================================================================
+
+namespace cpu_dispatch_ {
+
+template <typename Kernel, typename Run = decltype(&Kernel::run)>
+struct Targets;
+
+template <typename Kernel, typename... Args>
+struct Targets<Kernel, void (*)(Args...)> {
+
+    using Entry = void (*)(Args...);
+
+    __attribute__((optimize("fp-contract=off")))
+    static void generic(Args... args) {
+        Kernel::run(args...);
+    }
+
+#if CPU_DISPATCH
+
+    __attribute__((target("avx2"), optimize("fp-contract=off")))
+    static void avx2(Args... args) {
+        Kernel::run(args...);
+    }
+
+    __attribute__((target("avx512f,avx512vl"), optimize("fp-contract=off")))
+    static void avx512(Args... args) {
+        Kernel::run(args...);
+    }
+
+#endif
+
+    // Pick the kernel for this CPU
+    static Entry select() {
+#if CPU_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")
+                && __builtin_cpu_supports("avx512vl")) {
+            return avx512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return avx2;
+        }
+#endif
+        return generic;
+    }
+
+};
+
+} // end namespace cpu_dispatch_
+
+// ============================================================================
+
+// The best build of Kernel::run for this CPU (selected once)
+template <typename Kernel>
+auto get_kernel() {
+    using Targets = cpu_dispatch_::Targets<Kernel>;
+    static typename Targets::Entry const k = Targets::select();
+    return k;
+}
+
+#endif // CPU_DISPATCH_HPP
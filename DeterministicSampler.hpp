@@ -0,0 +1,368 @@
+#ifndef DETERMINISTIC_SAMPLER_HPP
+#define DETERMINISTIC_SAMPLER_HPP
+
+// Computes the output PDF of ProbabilitySampler without Monte Carlo.
+//
+// With a piecewise-linear inverse CDF Q (knots y_n = Q(n/N)), the input X is
+// piecewise uniform: each segment [y_n, y_n+1] holds probability 1/N (a flat
+// segment is an atom at y_n), and its CDF F is piecewise linear.  The output
+// value is Z = X_0 / (X_0 + S) with S the sum of the other N_SUM - 1 values,
+// so for t < 1 and c = t / (1 - t)
+//     P(Z <= t) = P(X_0 <= c S) = E[F(c S)].
+// -- N_SUM = 1 : no normalization, Z = X (see output_cdf_one_).
+// -- N_SUM = 2 : S is another X.  Between the knots y_k and the points y_j / c
+//                both the density of S and F(c s) are simple (constant and
+//                linear), so the integral is exact with the midpoint rule.
+//                Both sequences of points are sorted, so they are merged in
+//                one pass.
+// -- N_SUM > 2 : the distribution of S is built by convolving the cell masses
+//                of X on a uniform grid (RESOLUTION cells per unit, by FFT),
+//                then the expectation is summed over the grid.  F(c s) is
+//                linear between the points y_k / c, so with prefix sums of the
+//                grid masses each output point costs one pass over the knots.
+//                The error shrinks with the grid spacing.
+// Every component of a tuple has the same distribution, so the result is the
+// same for deposit_all true or false.
+//
+// The result is a BinnedPDF holding probability masses (summing to one), so
+// get_pdf() and friends work as they do on a sampled PDF.  The clamps the
+// sampler applies to avoid dividing by zero and to keep values below one are
+// below floating-point resolution and are ignored.
+
+#include "BinnedPDF.hpp"
+#include "PiecewiseLinearFunction.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+// ============================================================================
+// Fast Fourier transform
+
+namespace deterministic_sampler_ {
+
+// In-place radix-2 transform (the size of a must be a power of two); the
+// inverse is not divided by the size.
+inline void fft(std::vector<std::complex<double>> & a, bool const inverse) {
+    std::size_t const n = a.size();
+    for (std::size_t i = 1, j = 0; i < n; i++) {
+        std::size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(a[i], a[j]);
+        }
+    }
+    // Twiddle factors computed directly, not by recurrence, for accuracy
+    double const pi = std::acos(-1.0);
+    std::vector<std::complex<double>> w(n / 2);
+    for (std::size_t k = 0; k < n / 2; k++) {
+        double angle = (inverse ? 2 : -2) * pi * double(k) / double(n);
+        w[k] = {std::cos(angle), std::sin(angle)};
+    }
+    for (std::size_t len = 2; len <= n; len <<= 1) {
+        std::size_t half = len / 2;
+        std::size_t step = n / len;
+        for (std::size_t i = 0; i < n; i += len) {
+            for (std::size_t k = 0; k < half; k++) {
+                std::complex<double> u = a[i + k];
+                std::complex<double> x = a[i + k + half];
+                std::complex<double> t = w[k * step];
+                // (written out: std::complex's operator* checks for NaNs)
+                std::complex<double> v(
+                        x.real() * t.real() - x.imag() * t.imag(),
+                        x.real() * t.imag() + x.imag() * t.real());
+                a[i + k] = u + v;
+                a[i + k + half] = u - v;
+            }
+        }
+    }
+}
+
+} // end namespace deterministic_sampler_
+
+// ============================================================================
+
+template <
+    bool deposit_all,
+    typename Float,
+    typename std::size_t N_SUM,
+    typename std::size_t N_BINS,
+    typename std::size_t RESOLUTION = 16 * N_BINS>
+class DeterministicSampler {
+
+    // ------------------------------------------------------------------------
+    // Types
+
+public:
+
+    using PDF = BinnedPDF<Float, Float, N_BINS>;
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Takes inverse CDF
+    template <typename Function>
+    DeterministicSampler(Function && inverse_cdf)
+    {
+        set_inverse_cdf(PiecewiseLinearFunction<Float, N_BINS>(inverse_cdf));
+    }
+
+    // ------------------------------------------------------------------------
+    // Replace the inverse CDF
+
+public:
+
+    void set_inverse_cdf(PiecewiseLinearFunction<Float, N_BINS> const & inverse_cdf) {
+        knots_ = inverse_cdf.get_knots();
+        // Guard against rounding in the reconstructed knots
+        knots_.front() = Float{0};
+        knots_.back() = Float{1};
+        for (std::size_t n = 1; n <= N_BINS; n++) {
+            knots_[n] = std::min(Float{1}, std::max(knots_[n], knots_[n-1]));
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // CDF and density of the input distribution
+
+private:
+
+    // Index of the segment containing v (largest n with y_n <= v)
+    std::size_t segment_(double const v) const {
+        auto it = std::upper_bound(knots_.begin(), knots_.end(), Float(v));
+        return std::size_t(it - knots_.begin()) - 1;
+    }
+
+    double cdf_(double const v) const {
+        if (v < 0) {
+            return 0;
+        }
+        return cdf_in_(v, segment_(v));
+    }
+
+    // The same for v >= 0 in segment n
+    double cdf_in_(double const v, std::size_t const n) const {
+        if (n >= N_BINS) {
+            return 1;
+        }
+        double y0 = knots_[n];
+        double y1 = knots_[n+1];
+        return (double(n) + (v - y0) / (y1 - y0)) / double(N_BINS);
+    }
+
+    // ------------------------------------------------------------------------
+    // Output CDF, P(Z <= t)
+
+private:
+
+    // For N_SUM = 1 the sampler's clamps cancel and a value exactly on a bin
+    // edge lands in the upper bin, so the bins need P(X < t).  (With
+    // normalization, the final clamp moves such values into the lower bin, so
+    // P(Z <= t) is right for N_SUM > 1.)
+    double output_cdf_one_(double const t) const {
+        auto it = std::lower_bound(knots_.begin(), knots_.end(), Float(t));
+        std::size_t n = std::size_t(it - knots_.begin()) - 1;
+        if (n >= N_BINS) {
+            return 1;
+        }
+        double y0 = knots_[n];
+        double y1 = knots_[n+1];
+        return (double(n) + std::min(1.0, (t - y0) / (y1 - y0))) / double(N_BINS);
+    }
+
+    double output_cdf_two_(double const t) const {
+        double c = t / (1 - t);
+        constexpr double NONE = std::numeric_limits<double>::infinity();
+        // Breakpoints: the knots (where the density of S changes) and the
+        // points where c s crosses a knot (where F(c s) changes slope), taken
+        // in order from the two sorted sequences.  Past the breakpoints a,
+        // i knots and j crossings have been taken, so S lies in segment
+        // i - 1 and c S in segment j - 1 up to the next breakpoint.
+        std::size_t i = 0;
+        std::size_t j = 0;
+        double a = 0;
+        double p{0};
+        while (true) {
+            while (i <= N_BINS && double(knots_[i]) <= a) {
+                i++;
+            }
+            while (j <= N_BINS && double(knots_[j]) / c <= a) {
+                j++;
+            }
+            double b = std::min(i <= N_BINS ? double(knots_[i]) : NONE,
+                    j <= N_BINS ? double(knots_[j]) / c : NONE);
+            if (b > 1) {
+                break;
+            }
+            std::size_t k = i - 1;
+            double density = 1.0 / (double(N_BINS) * double(knots_[k+1] - knots_[k]));
+            p += density * (b - a) * cdf_in_(c * 0.5 * (a + b), j - 1);
+            a = b;
+        }
+        // Atoms (flat segments), with c y_k rising through the segments
+        std::size_t n = 0;
+        for (std::size_t k = 0; k < N_BINS; k++) {
+            if (knots_[k+1] == knots_[k]) {
+                double v = c * double(knots_[k]);
+                while (n < N_BINS && double(knots_[n+1]) <= v) {
+                    n++;
+                }
+                p += cdf_in_(v, n) / double(N_BINS);
+            }
+        }
+        return p;
+    }
+
+    // Grid point i of the sum scaled by c (the sum of N_SUM - 1 cell
+    // midpoints sits at (i + (N_SUM - 1) / 2) h)
+    static double scaled_sum_(double const c, std::size_t const i) {
+        constexpr double offset = 0.5 * double(N_SUM - 1);
+        return c * (double(i) + offset) / double(RESOLUTION);
+    }
+
+    // First grid point i with c s_i >= v
+    std::size_t first_at_(double const c, double const v) const {
+        constexpr double offset = 0.5 * double(N_SUM - 1);
+        std::size_t const size = sum_masses_.size();
+        double guess = std::ceil(v / c * double(RESOLUTION) - offset);
+        std::size_t i = guess <= 0 ? 0
+            : std::min(size, std::size_t(std::min(guess, double(size))));
+        // (settle rounding in the guess)
+        while (i > 0 && scaled_sum_(c, i - 1) >= v) {
+            i--;
+        }
+        while (i < size && scaled_sum_(c, i) < v) {
+            i++;
+        }
+        return i;
+    }
+
+    double output_cdf_many_(double const t) const {
+        // Fewer grid points than this in a segment are summed one by one: the
+        // prefix sums lose their accuracy when divided by a narrow segment.
+        constexpr std::size_t FEW_POINTS = 16;
+        double c = t / (1 - t);
+        double p{0};
+        // The grid points [lo, hi) have c s in segment k
+        std::size_t lo = 0;
+        for (std::size_t k = 0; k < N_BINS; k++) {
+            std::size_t hi = first_at_(c, double(knots_[k+1]));
+            if (hi > lo) {
+                double y0 = knots_[k];
+                double width = double(knots_[k+1]) - y0;
+                if (hi - lo <= FEW_POINTS) {
+                    for (std::size_t i = lo; i < hi; i++) {
+                        p += sum_masses_[i] * cdf_in_(scaled_sum_(c, i), k);
+                    }
+                } else {
+                    double mass = mass_below_[hi] - mass_below_[lo];
+                    double moment = moment_below_[hi] - moment_below_[lo];
+                    p += (double(k) * mass + (c * moment - y0 * mass) / width)
+                        / double(N_BINS);
+                }
+            }
+            lo = hi;
+        }
+        // F(c s) = 1 above the last knot
+        return p + mass_below_.back() - mass_below_[lo];
+    }
+
+    // Distribution of the sum of N_SUM - 1 inputs on the grid, and its prefix
+    // sums of mass and of mass times s
+    void build_sum_masses_() {
+        double h = 1.0 / double(RESOLUTION);
+        std::size_t size = (N_SUM - 1) * (RESOLUTION - 1) + 1;
+        std::size_t fft_size = 1;
+        while (fft_size < size) {
+            fft_size <<= 1;
+        }
+        // Convolution power by FFT: transform, raise, transform back
+        std::vector<std::complex<double>> z(fft_size);
+        for (std::size_t i = 0; i < RESOLUTION; i++) {
+            z[i] = cdf_(double(i + 1) * h) - cdf_(double(i) * h);
+        }
+        deterministic_sampler_::fft(z, false);
+        for (auto & x : z) {
+            std::complex<double> power = x;
+            for (std::size_t n = 2; n < N_SUM; n++) {
+                power *= x;
+            }
+            x = power;
+        }
+        deterministic_sampler_::fft(z, true);
+        // (rounding leaves tiny negative masses where there are none)
+        sum_masses_.resize(size);
+        for (std::size_t i = 0; i < size; i++) {
+            sum_masses_[i] = std::max(0.0, z[i].real() / double(fft_size));
+        }
+        mass_below_.assign(size + 1, 0.0);
+        moment_below_.assign(size + 1, 0.0);
+        for (std::size_t i = 0; i < size; i++) {
+            mass_below_[i+1] = mass_below_[i] + sum_masses_[i];
+            moment_below_[i+1] = moment_below_[i]
+                + sum_masses_[i] * scaled_sum_(1, i);
+        }
+    }
+
+    double output_cdf_(double const t) const {
+        if (t <= 0) {
+            return 0;
+        }
+        if (t >= 1) {
+            return 1;
+        }
+        if constexpr (N_SUM == 1) {
+            return output_cdf_one_(t);
+        } else if constexpr (N_SUM == 2) {
+            return output_cdf_two_(t);
+        } else {
+            return output_cdf_many_(t);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Generate the output distribution from the input distribution
+
+public:
+
+    auto generate() {
+        if constexpr (N_SUM > 2) {
+            build_sum_masses_();
+        }
+        PDF pdf;
+        double previous = 0;
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            double next = output_cdf_(double(n + 1) / double(N_BINS));
+            pdf.add_to_bin(n, Float(std::max(0.0, next - previous)));
+            previous = next;
+        }
+        return pdf;
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    // Inverse CDF at all bin edges, including 0 and 1
+    std::array<Float, N_BINS+1> knots_;
+
+    // Grid masses of the sum of N_SUM - 1 inputs, and the sums of mass and of
+    // mass times s below each grid point (N_SUM > 2)
+    std::vector<double> sum_masses_;
+    std::vector<double> mass_below_;
+    std::vector<double> moment_below_;
+
+};
+
+#endif // DETERMINISTIC_SAMPLER_HPP
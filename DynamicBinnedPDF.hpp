@@ -0,0 +1,318 @@
+#ifndef DYNAMIC_BINNED_PDF_HPP
+#define DYNAMIC_BINNED_PDF_HPP
+
+// BinnedPDF with the number of bins chosen at run time.
+//
+// Same interface as BinnedPDF, except that n_bins() is a member function and
+// the arrays returned are std::vectors.  The storage is only reallocated when
+// the number of bins changes, so a PDF can be reused across runs.
+
+#include "BinnedPDF.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ============================================================================
+
+template <typename Float, typename Integer>
+class DynamicBinnedPDF {
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    // PDF of output distribution (mutable for flush_)
+    mutable std::vector<Integer> pdf_;
+
+    // Count
+    Integer count_;
+
+    // Compact counters of deposit_batch() (see BinnedPDF.hpp)
+    mutable std::vector<std::uint8_t> compact_;
+    mutable bool pending_{false};
+
+    // Uniformity statistics (see binned_pdf_::Statistics)
+    mutable binned_pdf_::Statistics<Integer> stats_;
+
+    // ------------------------------------------------------------------------
+
+    void flush_() const {
+        if (pending_) {
+            binned_pdf_::flush(compact_.data(), pdf_.data(), pdf_.size());
+            pending_ = false;
+        }
+    }
+
+    auto const & statistics_() const {
+        flush_();
+        stats_.update(pdf_.data(), pdf_.size());
+        return stats_;
+    }
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Default-constructs the object (mostly for testing).
+    DynamicBinnedPDF()
+        : count_(0)
+    {
+    }
+
+    // Constructs an empty PDF with n_bins bins.
+    explicit DynamicBinnedPDF(std::size_t const n_bins)
+        : pdf_(n_bins)
+    {
+        clear();
+    }
+
+    // Copies a fixed-size PDF.
+    template <typename std::size_t N_BINS>
+    DynamicBinnedPDF(BinnedPDF<Float, Integer, N_BINS> const & other) {
+        assign(other);
+    }
+
+    // ------------------------------------------------------------------------
+    // Change the number of bins (clears the PDF)
+
+public:
+
+    void resize(std::size_t const n_bins) {
+        pdf_.resize(n_bins);
+        clear();
+    }
+
+    // ------------------------------------------------------------------------
+    // Copy a fixed-size PDF
+
+public:
+
+    template <typename std::size_t N_BINS>
+    void assign(BinnedPDF<Float, Integer, N_BINS> const & other) {
+        auto const & bins = other.get_all_bins();
+        pdf_.assign(bins.begin(), bins.end());
+        compact_.clear();
+        pending_ = false;
+        stats_.stale = true;
+        count_ = other.count();
+    }
+
+    // ------------------------------------------------------------------------
+    // Add a value to the PDF
+
+public:
+
+    // Deposit a value in the PDF.
+    void deposit(Float const & x) {
+        assert(x >= Float{0});
+        assert(x < Float{1});
+        std::size_t index = std::size_t(x * pdf_.size());
+        stats_.add(pdf_[index], Integer{1});
+        pdf_[index]++;
+        count_++;
+    }
+
+    // Add a weight directly to a bin.
+    void add_to_bin(std::size_t const & index, Integer const & weight) {
+        assert(index < pdf_.size());
+        stats_.add(pdf_[index], weight);
+        pdf_[index] += weight;
+        count_ += weight;
+    }
+
+    // Deposits x[0..n) (see BinnedPDF::deposit_batch).
+    void deposit_batch(Float const * x, std::size_t const n) {
+        if (pdf_.size() >= binned_pdf_::COMPACT_BINS
+                && compact_.size() != pdf_.size()) {
+            compact_.assign(pdf_.size(), 0);
+        }
+        if (binned_pdf_::deposit_batch(x, n, pdf_.size(), compact_.data(),
+                    pdf_.data(), stats_)) {
+            pending_ = true;
+            stats_.stale = true;
+        }
+        count_ += Integer(n);
+    }
+
+    // Deposits x[0..n) with relaxed atomic increments (see
+    // BinnedPDF::deposit_batch_atomic).
+    void deposit_batch_atomic(Float const * x, std::size_t const n) {
+        binned_pdf_::deposit_atomic(x, n, pdf_.size(), pdf_.data());
+        __atomic_fetch_add(&count_, Integer(n), __ATOMIC_RELAXED);
+        __atomic_store_n(&stats_.stale, true, __ATOMIC_RELAXED);
+    }
+
+    // ------------------------------------------------------------------------
+    // Merge another PDF into this one
+
+public:
+
+    DynamicBinnedPDF & operator+=(DynamicBinnedPDF const & other) {
+        assert(other.pdf_.size() == pdf_.size());
+        other.flush_();
+        for (std::size_t n = 0; n < pdf_.size(); n++) {
+            pdf_[n] += other.pdf_[n];
+        }
+        count_ += other.count_;
+        stats_.stale = true;
+        return *this;
+    }
+
+    template <typename std::size_t N_BINS>
+    DynamicBinnedPDF & operator+=(BinnedPDF<Float, Integer, N_BINS> const & other) {
+        assert(N_BINS == pdf_.size());
+        auto const & bins = other.get_all_bins();
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            pdf_[n] += bins[n];
+        }
+        count_ += other.count();
+        stats_.stale = true;
+        return *this;
+    }
+
+    // ------------------------------------------------------------------------
+    // Clear the PDF
+
+public:
+
+    void clear() {
+        for (auto & x : pdf_) {
+            x = Integer{0};
+        }
+        if (pending_) {
+            std::fill(compact_.begin(), compact_.end(), std::uint8_t{0});
+            pending_ = false;
+        }
+        stats_.clear(pdf_.size());
+        count_ = 0;
+    }
+
+    // ------------------------------------------------------------------------
+    // How many samples have been deposited?
+
+public:
+
+    auto count() const {
+        return count_;
+    }
+
+    // ------------------------------------------------------------------------
+    // How many bins are there?
+
+public:
+
+    std::size_t n_bins() const {
+        return pdf_.size();
+    }
+
+    // ------------------------------------------------------------------------
+    // Uniformity statistics (see BinnedPDF)
+
+public:
+
+    Float sum_of_squares() const {
+        return Float(statistics_().sum_sq);
+    }
+
+    Integer min_count() const {
+        return statistics_().min;
+    }
+
+    Integer max_count() const {
+        return statistics_().max;
+    }
+
+    Float chi_square() const {
+        return Float(statistics_().chi_square(count_, pdf_.size()));
+    }
+
+    Float rms_deviation() const {
+        if (count_ == Integer{0}) {
+            return Float{0};
+        }
+        return std::sqrt(chi_square() / Float(count_));
+    }
+
+    Float max_deviation() const {
+        if (count_ == Integer{0}) {
+            return Float{0};
+        }
+        auto const & stats = statistics_();
+        Float expected = Float(count_) / Float(pdf_.size());
+        return std::max(Float(stats.max) - expected,
+                expected - Float(stats.min)) / expected;
+    }
+
+    // ------------------------------------------------------------------------
+    // Get the PDF
+
+public:
+
+    auto get_pdf() const {
+        flush_();
+        std::vector<Float> pdf_norm(pdf_.size());
+        Float denom = Float{1} / Float(count_);
+        for (std::size_t n = 0; n < pdf_.size(); n++) {
+            pdf_norm[n] = pdf_[n] * denom;
+        }
+        return pdf_norm;
+    }
+
+    // ------------------------------------------------------------------------
+    // Get the values in all bins
+
+public:
+
+    auto const & get_all_bins() const {
+        flush_();
+        return pdf_;
+    }
+
+    // ------------------------------------------------------------------------
+    // Get the values in a specified bin
+
+public:
+
+    auto get_bin(std::size_t const & index) const {
+        assert(index < pdf_.size());
+        flush_();
+        return pdf_[index];
+    }
+
+    // ------------------------------------------------------------------------
+    // Get the bin edges
+
+public:
+
+    auto get_bin_edges() const {
+        std::size_t n_bins = pdf_.size();
+        std::vector<Float> edges(n_bins + 1);
+        for (std::size_t n = 0; n <= n_bins; n++) {
+            edges[n] = Float(n) / Float(n_bins);
+        }
+        return edges;
+    }
+
+    // ------------------------------------------------------------------------
+    // Get the bin centers
+
+public:
+
+    auto get_bin_centers() const {
+        std::size_t n_bins = pdf_.size();
+        std::vector<Float> centers(n_bins);
+        for (std::size_t n = 0; n < n_bins; n++) {
+            centers[n] = (Float(n) + Float{0.5}) / Float(n_bins);
+        }
+        return centers;
+    }
+
+};
+
+#endif // DYNAMIC_BINNED_PDF_HPP
@@ -0,0 +1,177 @@
+#ifndef DYNAMIC_PIECEWISE_LINEAR_FUNCTION_HPP
+#define DYNAMIC_PIECEWISE_LINEAR_FUNCTION_HPP
+
+// PiecewiseLinearFunction with the number of bins chosen at run time.
+//
+// Built from the same points, the coefficients are computed the same way as
+// for PiecewiseLinearFunction<Float, N_BINS>, so both evaluate to identical
+// values.  The knots (function values at all bin edges) are kept as given,
+// which lets a fixed-size copy be built exactly (see
+// DynamicProbabilitySampler).
+
+#include "PiecewiseLinearFunction.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// ============================================================================
+
+template <typename Float>
+class DynamicPiecewiseLinearFunction {
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    // Function values at all bin edges, including (0,0) and (1,1)
+    std::vector<Float> knots_;
+
+    // Coefficients (y = m x + b)
+    std::vector<Float> slopes_;
+    std::vector<Float> intercepts_;
+
+    // ------------------------------------------------------------------------
+
+    Float bin_edge_(std::size_t const & n) const {
+        assert(n <= n_bins());
+        return Float(n) / Float(n_bins());
+    }
+
+    // ------------------------------------------------------------------------
+
+    void construct_coefficients_() {
+        std::size_t n_bins = knots_.size() - 1;
+        assert(knots_.front() == 0);
+        for (std::size_t n = 0; n < n_bins; n++) {
+            assert(knots_[n] <= knots_[n+1]);
+        }
+        assert(knots_.back() == 1);
+        slopes_.resize(n_bins);
+        intercepts_.resize(n_bins);
+        Float x0, y0;
+        Float x1{bin_edge_(0)};
+        Float y1{knots_[0]};
+        for (std::size_t n = 0; n < n_bins; n++) {
+            // Cycle points
+            x0 = x1;
+            y0 = y1;
+            // Fetch new points
+            x1 = bin_edge_(n+1);
+            y1 = knots_[n+1];
+            // Compute coefficients for y = m x + b
+            Float m = (y1 - y0) / (x1 - x0);
+            Float b = y1 - m * x1;
+            slopes_[n] = m;
+            intercepts_[n] = b;
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Default-constructs the object (mostly for testing).
+    DynamicPiecewiseLinearFunction() = default;
+
+    // Takes n_bins and the bin-edge function values at some resolution
+    // -- Assumes uniform binning and implies the points (0,0) and (1,1).
+    // -- n_bins - 1 points give the function exactly.
+    // -- Other numbers of points are linearly interpolated, the same way as
+    //    by the PiecewiseLinearFunction constructors.
+    DynamicPiecewiseLinearFunction(std::size_t const n_bins,
+            std::vector<Float> const & points_in)
+        : knots_(n_bins + 1)
+    {
+        assert(n_bins >= 1);
+        std::size_t n_pts = points_in.size();
+        knots_.front() = Float{0};
+        knots_.back() = Float{1};
+        if (n_pts + 1 == n_bins) {
+            for (std::size_t n = 0; n < n_pts; n++) {
+                knots_[n+1] = points_in[n];
+            }
+        } else if (n_pts > 0 && 2 * (n_pts + 1) == n_bins) {
+            for (std::size_t n = 0; n < n_pts; n++) {
+                auto & y1 = knots_[2*n];
+                auto & y2 = points_in[n];
+                knots_[2*n+1] = Float{0.5} * (y1 + y2);
+                knots_[2*n+2] = y2;
+            }
+            knots_[n_bins-1] = Float{0.5} * (points_in.back() + Float{1});
+        } else {
+            DynamicPiecewiseLinearFunction temp_func(n_pts + 1, points_in);
+            for (std::size_t n = 1; n < n_bins; n++) {
+                knots_[n] = temp_func(bin_edge_(n));
+            }
+        }
+        construct_coefficients_();
+    }
+
+    // Takes the interior bin-edge function values (n_bins - 1 of them)
+    explicit DynamicPiecewiseLinearFunction(std::vector<Float> const & points_in)
+        : DynamicPiecewiseLinearFunction(points_in.size() + 1, points_in)
+    {
+    }
+
+    // ------------------------------------------------------------------------
+    // Size
+
+public:
+
+    std::size_t n_bins() const {
+        return knots_.size() - 1;
+    }
+
+    // ------------------------------------------------------------------------
+    // Get bin edges (helps with constructing function)
+
+public:
+
+    static auto get_bin_edges(std::size_t const n_bins) {
+        std::vector<Float> bin_edges(n_bins - 1);
+        for (std::size_t n = 0; n < n_bins - 1; n++) {
+            bin_edges[n] = Float(n+1) / Float(n_bins);
+        }
+        return bin_edges;
+    }
+
+    // ------------------------------------------------------------------------
+    // Get the function values at all bin edges, including (0,0) and (1,1)
+
+public:
+
+    auto const & get_knots() const {
+        return knots_;
+    }
+
+    // ------------------------------------------------------------------------
+    // Call operator to evaluate function
+
+public:
+
+    auto operator() (Float const & x) const {
+        assert(x >= Float{0});
+        assert(x <  Float{1});
+        std::size_t index = std::size_t(x * n_bins());
+        auto const & m = slopes_[index];
+        auto const & b = intercepts_[index];
+        return m * x + b;
+    }
+
+    // Evaluates the function at in[0..n) and writes the results to out[0..n)
+    // -- Identical to calling operator() on each point.
+    // -- All inputs must be in [0,1).
+    // -- in and out must not overlap.
+    void evaluate(Float const * in, Float * out, std::size_t const n) const {
+        // (the kernels of PiecewiseLinearFunction)
+        get_kernel<piecewise_linear_function_::EvaluateDynamic<Float>>()(
+                slopes_.data(), intercepts_.data(), in, out, n, n_bins());
+    }
+
+};
+
+#endif // DYNAMIC_PIECEWISE_LINEAR_FUNCTION_HPP
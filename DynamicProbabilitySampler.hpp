@@ -0,0 +1,579 @@
+#ifndef DYNAMIC_PROBABILITY_SAMPLER_HPP
+#define DYNAMIC_PROBABILITY_SAMPLER_HPP
+
+// ProbabilitySampler with deposit_all, N_SUM and N_BINS chosen at run time, so
+// one binary can run a sweep over configurations.
+//
+// -- Configurations built from the SumSizes and BinSizes lists (both
+//    deposit_all modes) run the compile-time ProbabilitySampler, found through
+//    a dispatch table when the sampler is constructed.
+// -- Any other configuration runs a generic sampler with run-time loops.  It
+//    draws the same chunks of uniforms as ProbabilitySampler, so both give
+//    identical results for the same seed and stream.
+// -- The sampler and its work space (for a compile-time sampler, one
+//    fixed-size PDF) live as long as the object, generate(pdf) reuses the
+//    caller's PDF, and sample_range deposits straight into it, so repeated
+//    runs do not allocate.
+
+#include "BinnedPDF.hpp"
+#include "DynamicBinnedPDF.hpp"
+#include "DynamicPiecewiseLinearFunction.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "RNGPolicies.hpp"
+#include "StoppingRules.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// ============================================================================
+
+// List of sizes with compile-time kernels
+template <typename std::size_t... Ns>
+struct SizeList {};
+
+namespace dynamic_probability_sampler_ {
+
+// Same counters as ProbabilitySampler's default
+template <typename Float>
+using PDF = DynamicBinnedPDF<Float, std::uint64_t>;
+
+template <typename Float>
+using Function = DynamicPiecewiseLinearFunction<Float>;
+
+template <typename Float>
+using StoppingRule = std::function<std::size_t(PDF<Float> const &)>;
+
+// ============================================================================
+// Interface of the samplers behind DynamicProbabilitySampler
+
+template <typename Float>
+class Backend {
+
+public:
+
+    virtual ~Backend() = default;
+
+    virtual void set_inverse_cdf(Function<Float> const & inverse_cdf) = 0;
+    virtual void set_seed(std::uint64_t seed) = 0;
+    virtual void set_stream(std::uint64_t stream) = 0;
+    virtual void set_threads(std::size_t n_threads) = 0;
+    virtual void set_stopping_rule(StoppingRule<Float> rule) = 0;
+    virtual void generate(PDF<Float> & pdf) = 0;
+    virtual void sample_range(std::size_t first, std::size_t last,
+            PDF<Float> & pdf, std::vector<Float> & buffer) const = 0;
+
+};
+
+// ============================================================================
+// Compile-time sampler
+
+template <
+    bool deposit_all,
+    typename Float,
+    typename std::size_t N_SUM,
+    typename std::size_t N_BINS,
+    typename RNG>
+class FixedBackend : public Backend<Float> {
+
+    using Sampler_ = ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG>;
+
+    // Built from the same knots, the fixed-size function has the same
+    // coefficients.
+    static auto to_fixed_(Function<Float> const & inverse_cdf) {
+        assert(inverse_cdf.n_bins() == N_BINS);
+        auto const & knots = inverse_cdf.get_knots();
+        std::array<Float, N_BINS-1> points;
+        for (std::size_t n = 0; n < N_BINS-1; n++) {
+            points[n] = knots[n+1];
+        }
+        return PiecewiseLinearFunction<Float, N_BINS>(points);
+    }
+
+public:
+
+    FixedBackend(Function<Float> const & inverse_cdf)
+        : sampler_(to_fixed_(inverse_cdf))
+    {
+    }
+
+    void set_inverse_cdf(Function<Float> const & inverse_cdf) override {
+        sampler_.set_inverse_cdf(to_fixed_(inverse_cdf));
+    }
+
+    void set_seed(std::uint64_t const seed) override {
+        sampler_.set_seed(seed);
+    }
+
+    void set_stream(std::uint64_t const stream) override {
+        sampler_.set_stream(stream);
+    }
+
+    void set_threads(std::size_t const n_threads) override {
+        sampler_.set_threads(n_threads);
+    }
+
+    // The rule sees a copy of the PDF, made once per round.
+    void set_stopping_rule(StoppingRule<Float> rule) override {
+        sampler_.set_stopping_rule(
+                [this, rule](typename Sampler_::PDF const & pdf) {
+                    view_.assign(pdf);
+                    return rule(view_);
+                });
+    }
+
+    // Through a fixed-size PDF kept for the backend's lifetime (on the heap,
+    // as large ones overflow the stack)
+    void generate(PDF<Float> & pdf) override {
+        if (!fixed_) {
+            fixed_ = std::make_unique<typename Sampler_::PDF>();
+        }
+        sampler_.generate(*fixed_);
+        pdf.assign(*fixed_);
+    }
+
+    // Straight into pdf (see ProbabilitySampler::sample_range)
+    void sample_range(std::size_t const first, std::size_t const last,
+            PDF<Float> & pdf, std::vector<Float> & buffer) const override {
+        assert(pdf.n_bins() == N_BINS);
+        sampler_.sample_range(first, last, pdf, buffer);
+    }
+
+private:
+
+    Sampler_ sampler_;
+    PDF<Float> view_;
+    std::unique_ptr<typename Sampler_::PDF> fixed_;
+
+};
+
+// ============================================================================
+// Run-time sampler
+// -- Follows ProbabilitySampler step for step (chunks, blocks, clamps and
+//    normalization), with N_SUM and N_BINS as run-time values.
+
+template <typename Float, typename RNG>
+class GenericBackend : public Backend<Float> {
+
+    using Engine_ = typename RNG::engine_type;
+
+    // The same chunks and blocks as ProbabilitySampler
+    static constexpr std::size_t CHUNK_TUPLES_ =
+        probability_sampler_::CHUNK_TUPLES;
+    static constexpr std::size_t BLOCK_TUPLES_ =
+        probability_sampler_::BLOCK_TUPLES;
+
+public:
+
+    GenericBackend(bool const deposit_all, std::size_t const n_sum,
+            Function<Float> const & inverse_cdf)
+        : deposit_all_(deposit_all)
+        , n_sum_(n_sum)
+        , inverse_cdf_(inverse_cdf)
+    {
+        assert(n_sum >= 1);
+        assert(rng_dimension_<RNG>::value == 0
+                || rng_dimension_<RNG>::value == n_sum);
+    }
+
+    void set_inverse_cdf(Function<Float> const & inverse_cdf) override {
+        assert(inverse_cdf.n_bins() == inverse_cdf_.n_bins());
+        inverse_cdf_ = inverse_cdf;
+    }
+
+    void set_seed(std::uint64_t const seed) override {
+        seed_ = seed;
+        current_seed_ = seed;
+    }
+
+    void set_stream(std::uint64_t const stream) override {
+        stream_ = stream;
+    }
+
+    void set_threads(std::size_t const n_threads) override {
+        n_threads_ = n_threads;
+    }
+
+    void set_stopping_rule(StoppingRule<Float> rule) override {
+        stopping_rule_ = std::move(rule);
+    }
+
+    void generate(PDF<Float> & pdf) override {
+        pdf.resize(inverse_cdf_.n_bins());
+        set_up_rng_();
+        std::size_t per_tuple = deposit_all_ ? n_sum_ : 1;
+        std::size_t n_tuples = 0;
+        std::size_t n_deposits;
+        while ((n_deposits = stopping_rule_(pdf)) > 0) {
+            std::size_t n_new = (n_deposits + per_tuple - 1) / per_tuple;
+            sample_tuples_(n_tuples, n_tuples + n_new, pdf);
+            n_tuples += n_new;
+        }
+    }
+
+    void sample_range(std::size_t const first, std::size_t const last,
+            PDF<Float> & pdf, std::vector<Float> & buffer) const override {
+        assert(seed_);
+        for (auto const & piece : split_pieces_(first, last)) {
+            sample_piece_(piece[0], piece[1], pdf, buffer);
+        }
+    }
+
+private:
+
+    void set_up_rng_() {
+        if (seed_) {
+            current_seed_ = *seed_;
+        } else {
+            std::random_device rd;
+            current_seed_ = (std::uint64_t(rd()) << 32) | std::uint64_t(rd());
+        }
+    }
+
+    Engine_ make_chunk_engine_(std::size_t const chunk) const {
+        if constexpr (RNG::seekable) {
+            auto engine = RNG::make_engine(current_seed_, stream_);
+            RNG::skip(engine, std::uint64_t(chunk) * CHUNK_TUPLES_ * n_sum_);
+            return engine;
+        } else {
+            return RNG::make_engine(current_seed_, (stream_ << 32) ^ chunk);
+        }
+    }
+
+    static Float clamp_random_number_(Float x) {
+        x = probability_sampler_::toward_one(x);
+        x = std::max(x, std::numeric_limits<Float>::min());
+        return x;
+    }
+
+    // Normalize one tuple into out[0..n_sum) and return the end of the values
+    // to deposit
+    Float * normalize_tuple_(Float const * drawn, Float * out) const {
+        Float sum{0};
+        for (std::size_t i = 0; i < n_sum_; i++) {
+            out[i] = clamp_random_number_(drawn[i]);
+            sum += out[i];
+        }
+        if (n_sum_ > 1) {
+            Float denom = Float{1} / sum;
+            for (std::size_t i = 0; i < n_sum_; i++) {
+                out[i] *= denom;
+            }
+        }
+        std::size_t n_deposit = deposit_all_ ? n_sum_ : 1;
+        for (std::size_t i = 0; i < n_deposit; i++) {
+            out[i] = probability_sampler_::toward_zero(out[i]);
+        }
+        return out + n_deposit;
+    }
+
+    // Buffer layout: uniforms, then inverse-CDF values, then the values to
+    // deposit (a block each)
+    void sample_piece_(std::size_t const first, std::size_t const last,
+            PDF<Float> & pdf, std::vector<Float> & buffer) const {
+        std::size_t chunk = first / CHUNK_TUPLES_;
+        assert(last <= (chunk + 1) * CHUNK_TUPLES_);
+        auto engine = make_chunk_engine_(chunk);
+        buffer.resize(3 * BLOCK_TUPLES_ * n_sum_);
+        Float * u_block = buffer.data();
+        Float * x_block = buffer.data() + BLOCK_TUPLES_ * n_sum_;
+        Float * d_block = buffer.data() + 2 * BLOCK_TUPLES_ * n_sum_;
+        std::size_t offset = first - chunk * CHUNK_TUPLES_;
+        if constexpr (RNG::seekable) {
+            RNG::skip(engine, std::uint64_t(offset) * n_sum_);
+        } else {
+            while (offset > 0) {
+                std::size_t n_block = std::min(BLOCK_TUPLES_, offset);
+                fill_uniforms<RNG>(engine, u_block, n_block * n_sum_);
+                offset -= n_block;
+            }
+        }
+        for (std::size_t n = first; n < last; n += BLOCK_TUPLES_) {
+            std::size_t n_block = std::min(BLOCK_TUPLES_, last - n);
+            fill_uniforms<RNG>(engine, u_block, n_block * n_sum_);
+            inverse_cdf_.evaluate(u_block, x_block, n_block * n_sum_);
+            Float const * x = x_block;
+            Float * d = d_block;
+            for (std::size_t t = 0; t < n_block; t++, x += n_sum_) {
+                d = normalize_tuple_(x, d);
+            }
+            pdf.deposit_batch(d_block, std::size_t(d - d_block));
+        }
+    }
+
+    static auto split_pieces_(std::size_t const first, std::size_t const last) {
+        std::vector<std::array<std::size_t, 2>> pieces;
+        for (std::size_t n = first; n < last; ) {
+            std::size_t end = std::min(last, (n / CHUNK_TUPLES_ + 1) * CHUNK_TUPLES_);
+            pieces.push_back({n, end});
+            n = end;
+        }
+        return pieces;
+    }
+
+    void sample_tuples_(std::size_t const first, std::size_t const last,
+            PDF<Float> & pdf) {
+        auto pieces = split_pieces_(first, last);
+        std::size_t n_threads = n_threads_;
+        if (n_threads == 0) {
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        n_threads = std::min(n_threads, pieces.size());
+        if (buffers_.size() < n_threads) {
+            buffers_.resize(n_threads);
+        }
+        if (n_threads <= 1) {
+            for (auto const & piece : pieces) {
+                sample_piece_(piece[0], piece[1], pdf, buffers_[0]);
+            }
+            return;
+        }
+        if (partials_.size() < n_threads) {
+            partials_.resize(n_threads);
+        }
+        std::atomic<std::size_t> next_piece{0};
+        std::vector<std::thread> workers;
+        workers.reserve(n_threads);
+        for (std::size_t t = 0; t < n_threads; t++) {
+            workers.emplace_back([&, t]() {
+                partials_[t].resize(pdf.n_bins());
+                std::size_t p;
+                while ((p = next_piece.fetch_add(1)) < pieces.size()) {
+                    sample_piece_(pieces[p][0], pieces[p][1], partials_[t],
+                            buffers_[t]);
+                }
+            });
+        }
+        for (auto & w : workers) {
+            w.join();
+        }
+        for (std::size_t t = 0; t < n_threads; t++) {
+            pdf += partials_[t];
+        }
+    }
+
+private:
+
+    bool deposit_all_;
+    std::size_t n_sum_;
+    Function<Float> inverse_cdf_;
+
+    std::optional<std::uint64_t> seed_;
+    std::uint64_t current_seed_{0};
+    std::uint64_t stream_{0};
+
+    std::size_t n_threads_{1};
+
+    StoppingRule<Float> stopping_rule_{FixedCount(1000000)};
+
+    std::vector<std::vector<Float>> buffers_;
+    std::vector<PDF<Float>> partials_;
+
+};
+
+// ============================================================================
+// Dispatch table: (deposit_all, N_SUM, N_BINS) -> compile-time sampler
+
+template <typename Float>
+using Factory = std::unique_ptr<Backend<Float>> (*)(Function<Float> const &);
+
+template <typename Float>
+using Table = std::map<std::tuple<bool, std::size_t, std::size_t>, Factory<Float>>;
+
+template <bool deposit_all, typename Float, std::size_t N_SUM,
+    std::size_t N_BINS, typename RNG>
+std::unique_ptr<Backend<Float>> make_fixed(Function<Float> const & inverse_cdf) {
+    return std::make_unique<FixedBackend<deposit_all, Float, N_SUM, N_BINS, RNG>>(
+            inverse_cdf);
+}
+
+// Quasi-random policies only work for their own dimension.
+template <typename Float, typename RNG, std::size_t N_SUM, std::size_t... N_BINS>
+void add_entries(Table<Float> & table, SizeList<N_BINS...>) {
+    constexpr std::size_t DIM = rng_dimension_<RNG>::value;
+    if constexpr (DIM == 0 || DIM == N_SUM) {
+        ((table[{false, N_SUM, N_BINS}] = &make_fixed<false, Float, N_SUM, N_BINS, RNG>,
+          table[{true, N_SUM, N_BINS}] = &make_fixed<true, Float, N_SUM, N_BINS, RNG>),
+         ...);
+    }
+}
+
+template <typename Float, typename RNG, typename BinSizes, std::size_t... N_SUM>
+Table<Float> make_table(SizeList<N_SUM...>) {
+    Table<Float> table;
+    (add_entries<Float, RNG, N_SUM>(table, BinSizes{}), ...);
+    return table;
+}
+
+template <typename Float, typename RNG, typename SumSizes, typename BinSizes>
+Table<Float> const & get_table() {
+    static Table<Float> const table = make_table<Float, RNG, BinSizes>(SumSizes{});
+    return table;
+}
+
+} // end namespace dynamic_probability_sampler_
+
+// ============================================================================
+
+template <
+    typename Float,
+    typename RNG = MersenneTwisterRNG<Float>,
+    typename SumSizes = SizeList<1, 2, 3, 4>,
+    typename BinSizes = SizeList<16, 64, 256, 1024>>
+class DynamicProbabilitySampler {
+
+    // ------------------------------------------------------------------------
+    // Types
+
+public:
+
+    using PDF = dynamic_probability_sampler_::PDF<Float>;
+    using Function = dynamic_probability_sampler_::Function<Float>;
+    using StoppingRule = dynamic_probability_sampler_::StoppingRule<Float>;
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Takes the configuration and the inverse CDF (which sets N_BINS)
+    DynamicProbabilitySampler(bool const deposit_all, std::size_t const n_sum,
+            Function const & inverse_cdf)
+        : deposit_all_(deposit_all)
+        , n_sum_(n_sum)
+        , n_bins_(inverse_cdf.n_bins())
+    {
+        auto const & table = dynamic_probability_sampler_::get_table<
+            Float, RNG, SumSizes, BinSizes>();
+        auto it = table.find({deposit_all, n_sum, n_bins_});
+        if (it != table.end()) {
+            backend_ = it->second(inverse_cdf);
+            specialized_ = true;
+        } else {
+            backend_ = std::make_unique<
+                dynamic_probability_sampler_::GenericBackend<Float, RNG>>(
+                        deposit_all, n_sum, inverse_cdf);
+            specialized_ = false;
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Configuration
+
+public:
+
+    bool deposit_all() const {
+        return deposit_all_;
+    }
+
+    std::size_t n_sum() const {
+        return n_sum_;
+    }
+
+    std::size_t n_bins() const {
+        return n_bins_;
+    }
+
+    // Is a compile-time sampler used for this configuration?
+    bool specialized() const {
+        return specialized_;
+    }
+
+    // ------------------------------------------------------------------------
+    // Configure the sampling (see ProbabilitySampler)
+
+public:
+
+    // The new inverse CDF must have the same number of bins.
+    void set_inverse_cdf(Function const & inverse_cdf) {
+        assert(inverse_cdf.n_bins() == n_bins_);
+        backend_->set_inverse_cdf(inverse_cdf);
+    }
+
+    void set_seed(std::uint64_t const seed) {
+        backend_->set_seed(seed);
+    }
+
+    void set_stream(std::uint64_t const stream) {
+        backend_->set_stream(stream);
+    }
+
+    void set_stopping_rule(StoppingRule rule) {
+        backend_->set_stopping_rule(std::move(rule));
+    }
+
+    void set_threads(std::size_t const n_threads) {
+        backend_->set_threads(n_threads);
+    }
+
+    // ------------------------------------------------------------------------
+    // Generate the output distribution from the input distribution
+
+public:
+
+    auto generate() {
+        PDF pdf;
+        generate(pdf);
+        return pdf;
+    }
+
+    // Fills the given PDF, reusing its storage.
+    void generate(PDF & pdf) {
+        backend_->generate(pdf);
+    }
+
+    // ------------------------------------------------------------------------
+    // Sample part of a run (see ProbabilitySampler::sample_range)
+
+public:
+
+    // Tuples per chunk, as ProbabilitySampler::chunk_tuples()
+    static constexpr std::size_t chunk_tuples() {
+        return probability_sampler_::CHUNK_TUPLES;
+    }
+
+    // Tuples needed for a number of deposits
+    std::size_t tuples_for(std::size_t const n_deposits) const {
+        std::size_t per_tuple = deposit_all_ ? n_sum_ : 1;
+        return (n_deposits + per_tuple - 1) / per_tuple;
+    }
+
+    // Adds the tuples [first, last) of the run with the fixed seed to pdf
+    // (resized first if it has the wrong number of bins).  Safe to call from
+    // several threads at once.
+    void sample_range(std::size_t const first, std::size_t const last,
+            PDF & pdf, std::vector<Float> & buffer) const {
+        if (pdf.n_bins() != n_bins_) {
+            pdf.resize(n_bins_);
+        }
+        backend_->sample_range(first, last, pdf, buffer);
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    bool deposit_all_;
+    std::size_t n_sum_;
+    std::size_t n_bins_;
+
+    std::unique_ptr<dynamic_probability_sampler_::Backend<Float>> backend_;
+    bool specialized_;
+
+};
+
+#endif // DYNAMIC_PROBABILITY_SAMPLER_HPP
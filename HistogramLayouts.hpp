@@ -0,0 +1,38 @@
+#ifndef HISTOGRAM_LAYOUTS_HPP
+#define HISTOGRAM_LAYOUTS_HPP
+
+// Histogram layout policies for ProbabilitySampler: how the worker threads
+// of a multi-threaded run share the output PDF.
+//
+// A policy provides:
+// -- shared : whether the workers deposit straight into the output PDF
+//
+// Either way the result is the same; only the cost differs.
+
+// ============================================================================
+// One private shard per worker (the original layout)
+// -- Deposits are plain increments into the worker's own PDF.  The shards are
+//    kept on separate cache lines so that workers never write to the same
+//    line.
+// -- The shards are added into the output after every round of the stopping
+//    rule, which costs O(threads x N_BINS) per round, and the shards take
+//    threads x N_BINS counters of memory.
+
+struct ShardedHistogram {
+    static constexpr bool shared = false;
+};
+
+// ============================================================================
+// One histogram shared by all workers
+// -- Deposits are relaxed atomic increments into the output PDF, so there are
+//    no shards to allocate, clear or merge.
+// -- An atomic increment costs more than a plain one, and with few bins and
+//    many threads the workers contend for the same cache lines.  Worth it
+//    when the merge dominates: many short rounds, or N_BINS large compared
+//    to the deposits per round.
+
+struct AtomicHistogram {
+    static constexpr bool shared = true;
+};
+
+#endif // HISTOGRAM_LAYOUTS_HPP
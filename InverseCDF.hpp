@@ -0,0 +1,84 @@
+#ifndef INVERSE_CDF_HPP
+#define INVERSE_CDF_HPP
+
+// Inverse CDFs for ProbabilitySampler.
+//
+// The sampler takes any callable Float -> Float that maps [0,1) into [0,1]
+// and does not decrease (a value of one is nudged below it like any other):
+// the tabulated PiecewiseLinearFunction (the default), a table on
+// non-uniform bins (AdaptivePiecewiseLinearFunction), a closed-form inverse
+// written as a small struct or lambda, or a Polynomial.
+// -- A type with evaluate(in, out, n) is called once per block of values
+//    (PiecewiseLinearFunction dispatches to SIMD kernels there).
+// -- Anything else is called value by value in a plain loop the compiler
+//    can inline and vectorize, with no table lookup and no interpolation
+//    error.
+// ProbabilitySampler::generate_with_gradient takes derivatives with respect
+// to the knots of the uniform table, so it needs PiecewiseLinearFunction.
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+// ============================================================================
+// Block evaluation
+
+namespace inverse_cdfs_ {
+
+template <typename Function, typename Float, typename = void>
+struct has_evaluate : std::false_type {};
+
+template <typename Function, typename Float>
+struct has_evaluate<Function, Float, std::void_t<decltype(
+        std::declval<Function const &>().evaluate(std::declval<Float const *>(),
+            std::declval<Float *>(), std::size_t{}))>> : std::true_type {};
+
+// out[i] = f(in[i]) for i in [0, n)
+template <typename Float, typename Function>
+inline void evaluate(Function const & f, Float const * __restrict in,
+        Float * __restrict out, std::size_t const n) {
+    if constexpr (has_evaluate<Function, Float>::value) {
+        f.evaluate(in, out, n);
+    } else {
+        for (std::size_t i = 0; i < n; i++) {
+            out[i] = Float(f(in[i]));
+        }
+    }
+}
+
+} // end namespace inverse_cdfs_
+
+// ============================================================================
+// Polynomial c_0 + c_1 x + ... + c_{N-1} x^{N-1} (Horner's rule)
+// -- e.g. a fitted or truncated-series inverse CDF.  The caller keeps it
+//    within [0,1] on [0,1), rounding included, and nondecreasing.
+
+template <typename Float, std::size_t N_COEFFICIENTS>
+class Polynomial {
+
+    static_assert(N_COEFFICIENTS >= 1, "need at least one coefficient");
+
+public:
+
+    constexpr explicit Polynomial(
+            std::array<Float, N_COEFFICIENTS> const & coefficients)
+        : coefficients_(coefficients)
+    {
+    }
+
+    constexpr Float operator()(Float const x) const {
+        Float y = coefficients_[N_COEFFICIENTS - 1];
+        for (std::size_t k = N_COEFFICIENTS - 1; k-- > 0; ) {
+            y = y * x + coefficients_[k];
+        }
+        return y;
+    }
+
+private:
+
+    std::array<Float, N_COEFFICIENTS> coefficients_;
+
+};
+
+#endif // INVERSE_CDF_HPP
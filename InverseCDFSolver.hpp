@@ -0,0 +1,251 @@
+#ifndef INVERSE_CDF_SOLVER_HPP
+#define INVERSE_CDF_SOLVER_HPP
+
+// Solves for the inverse CDF of the input distribution that makes the
+// normalized output distribution uniform.
+//
+// Each iteration samples the output PDF for the current knots and applies a
+// damped fixed-point update
+//     Q_new(u) = (1 - damping) Q(u) + damping Q(G(u))
+// at the knots u = n / N_BINS, where Q is the current inverse CDF and G is
+// the output CDF (the running sum of the output PDF, exact at the bin edges).
+// The fixed point is G(u) = u, i.e. a uniform output.  For N_SUM = 1 the
+// output is the input, G = Q^-1, and a single undamped step is exact.  Both Q
+// and Q o G are non-decreasing with Q(0) = 0 and Q(1) = 1, so every update
+// is a valid inverse CDF.
+//
+// For N_SUM > 1 a uniform output may not be reachable at all (for N_SUM = 2
+// it needs input values arbitrarily close to zero), and full steps can
+// overshoot towards a degenerate inverse CDF.  The damping is therefore
+// adapted: a step that lowers the error is kept and the damping grows, a step
+// that raises it is undone and the damping halves.  The solve stops when the
+// error is within tolerance (converged) or the damping falls below its
+// minimum (stalled at the best inverse CDF found).
+//
+// The sampler, its RNG seed and its work space live as long as the solver;
+// each iteration only swaps in the new inverse CDF and moves to the next RNG
+// stream.  With common random numbers (set_common_random_numbers) every
+// iteration instead replays the uniforms of the first, so the change in error
+// between iterations reflects the change in the inverse CDF rather than
+// sampling noise.
+
+#include "BinnedPDF.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// ============================================================================
+
+template <
+    bool deposit_all,
+    typename Float,
+    typename std::size_t N_SUM,
+    typename std::size_t N_BINS,
+    typename RNG = XoshiroBlockRNG<Float>>
+class InverseCDFSolver {
+
+    // ------------------------------------------------------------------------
+    // Types
+
+public:
+
+    // Inverse CDF values at the interior bin edges
+    using Points = std::array<Float, N_BINS-1>;
+
+    using Function = PiecewiseLinearFunction<Float, N_BINS>;
+    using Sampler = ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG>;
+
+    // Outcome of solve()
+    struct Report {
+        // Best inverse CDF found
+        Points points;
+        // Number of iterations run
+        std::size_t iterations;
+        // Did the error drop below the tolerance?
+        bool converged;
+        // Error of the best inverse CDF's output PDF, relative to uniform
+        // -- rms_error : root-mean-square over bins of (p_n N_BINS - 1)
+        // -- max_error : largest |p_n N_BINS - 1|
+        double rms_error;
+        double max_error;
+        // rms_error for every iteration
+        std::vector<double> history;
+    };
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Takes the initial guess at the interior bin edges
+    InverseCDFSolver(Points const & initial)
+        : points_(initial)
+        , sampler_(Function(initial))
+    {
+        std::random_device rd;
+        sampler_.set_seed((std::uint64_t(rd()) << 32) | std::uint64_t(rd()));
+    }
+
+    // ------------------------------------------------------------------------
+    // Configuration
+
+public:
+
+    // Fraction of the fixed-point step taken on the first iteration
+    void set_damping(double const damping) {
+        initial_damping_ = damping;
+    }
+
+    // The solve stalls once the damping falls below this
+    void set_min_damping(double const min_damping) {
+        min_damping_ = min_damping;
+    }
+
+    // Converged once rms_error is at most this.  Zero (the default) uses
+    // twice the sampling noise of a uniform output, sqrt(N_BINS / count).
+    void set_tolerance(double const tolerance) {
+        tolerance_ = tolerance;
+    }
+
+    void set_max_iterations(std::size_t const max_iterations) {
+        max_iterations_ = max_iterations;
+    }
+
+    void set_seed(std::uint64_t const seed) {
+        sampler_.set_seed(seed);
+    }
+
+    // Replay the first iteration's uniforms in every iteration, keeping up to
+    // n_tuples tuples in memory or, given a path, in a memory-mapped file.
+    // Draws past n_tuples are regenerated each time (see UniformCache.hpp).
+    void set_common_random_numbers(std::size_t const n_tuples) {
+        sampler_.set_uniform_cache(
+                std::make_shared<typename Sampler::Cache>(n_tuples));
+    }
+
+    void set_common_random_numbers(std::string const & path,
+            std::size_t const n_tuples) {
+        sampler_.set_uniform_cache(
+                std::make_shared<typename Sampler::Cache>(path, n_tuples));
+    }
+
+    // Direct access to the sampler (threads, stopping rule, ...)
+    Sampler & sampler() {
+        return sampler_;
+    }
+
+    // ------------------------------------------------------------------------
+    // Error of an output PDF relative to uniform
+
+public:
+
+    template <typename PDF>
+    static std::array<double, 2> error(PDF const & pdf) {
+        return {double(pdf.rms_deviation()), double(pdf.max_deviation())};
+    }
+
+    // ------------------------------------------------------------------------
+    // Fixed-point update
+
+private:
+
+    // Step from the given points using their output PDF
+    template <typename PDF>
+    Points update_(Points const & points, PDF const & pdf,
+            double const damping) const {
+        Function q(points);
+        auto p = pdf.get_pdf();
+        Points stepped;
+        Float g{0};
+        for (std::size_t n = 0; n < N_BINS-1; n++) {
+            g += p[n];
+            Float q_of_g = g < Float{1} ? q(g) : Float{1};
+            stepped[n] = (Float{1} - Float(damping)) * points[n]
+                + Float(damping) * q_of_g;
+        }
+        return stepped;
+    }
+
+    // ------------------------------------------------------------------------
+    // Solve
+
+public:
+
+    Report solve() {
+        Report report;
+        report.converged = false;
+        report.iterations = 0;
+
+        // Best inverse CDF so far, with its output PDF and error
+        Points best = points_;
+        typename Sampler::PDF best_pdf;
+        double best_error = 0;
+        double damping = initial_damping_;
+
+        while (report.iterations < max_iterations_) {
+            sampler_.set_inverse_cdf(Function(points_));
+            sampler_.set_stream(stream_++);
+            auto pdf = sampler_.generate();
+            auto err = error(pdf);
+            report.iterations++;
+            report.history.push_back(err[0]);
+
+            if (report.iterations == 1 || err[0] < best_error) {
+                best = points_;
+                best_pdf = pdf;
+                best_error = err[0];
+                report.rms_error = err[0];
+                report.max_error = err[1];
+                if (report.iterations > 1) {
+                    damping = std::min(1.0, 1.5 * damping);
+                }
+            } else {
+                damping *= 0.5;
+            }
+
+            double tolerance = tolerance_ > 0 ? tolerance_
+                : 2.0 * std::sqrt(double(N_BINS) / double(best_pdf.count()));
+            if (best_error <= tolerance) {
+                report.converged = true;
+                break;
+            }
+            if (damping < min_damping_) {
+                break;
+            }
+            points_ = update_(best, best_pdf, damping);
+        }
+        points_ = best;
+        report.points = best;
+        return report;
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    // Current inverse CDF
+    Points points_;
+
+    // Sampler and its set-up, kept between iterations
+    Sampler sampler_;
+    std::uint64_t stream_{0};
+
+    // Settings
+    double initial_damping_{1.0};
+    double min_damping_{1.0 / 64};
+    double tolerance_{0};
+    std::size_t max_iterations_{100};
+
+};
+
+#endif // INVERSE_CDF_SOLVER_HPP
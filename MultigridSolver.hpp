@@ -0,0 +1,241 @@
+#ifndef MULTIGRID_SOLVER_HPP
+#define MULTIGRID_SOLVER_HPP
+
+// Solves for the inverse CDF coarse to fine.
+//
+// Solving directly at a high N_BINS spends many iterations, each sampling
+// enough deposits to resolve every bin, just to get the overall shape right.
+// Here the shape is found first at N_COARSE bins, where samples are cheap,
+// and each level after that doubles the bins:
+// -- The previous level's solution is prolonged with the half-resolution
+//    PiecewiseLinearFunction constructor (the new knots linearly
+//    interpolated between the old ones) and used as the initial guess of an
+//    InverseCDFSolver at the new resolution, which only has to correct the
+//    detail.
+// -- Finer levels run only a few iterations (two by default: one to measure
+//    the prolonged guess, one to correct it); the search for the best
+//    damping, and the iterations spent finding that it stalled, happen at
+//    the coarsest level.
+// -- Each iteration samples deposits(level) = deposits * growth^level, so the
+//    budget grows with the bins (the default growth of two keeps the sampling
+//    noise per bin, and with it the default tolerance, the same).
+// -- Level l is seeded with seed + l, so levels do not replay each other's
+//    random numbers.
+
+#include "InverseCDFSolver.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "StoppingRules.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// ============================================================================
+
+template <
+    bool deposit_all,
+    typename Float,
+    typename std::size_t N_SUM,
+    typename std::size_t N_BINS,
+    typename std::size_t N_COARSE = (N_BINS < 16 ? N_BINS : 16),
+    typename RNG = XoshiroBlockRNG<Float>>
+class MultigridSolver {
+
+    static_assert(N_COARSE >= 2 && N_COARSE <= N_BINS,
+            "need 2 <= N_COARSE <= N_BINS");
+    static_assert(N_BINS % N_COARSE == 0
+            && ((N_BINS / N_COARSE) & (N_BINS / N_COARSE - 1)) == 0,
+            "N_BINS must be N_COARSE times a power of two");
+
+    // ------------------------------------------------------------------------
+    // Types
+
+public:
+
+    // Inverse CDF values at the interior bin edges (finest level)
+    using Points = std::array<Float, N_BINS-1>;
+
+    // Outcome of one level
+    struct Level {
+        std::size_t n_bins;
+        std::size_t iterations;
+        bool converged;
+        double rms_error;
+        double max_error;
+        // Deposits sampled (requested per iteration, times iterations)
+        std::uint64_t deposits;
+    };
+
+    // Outcome of solve()
+    struct Report {
+        // Best inverse CDF found at the finest level
+        Points points;
+        // Coarsest first
+        std::vector<Level> levels;
+        // Deposits sampled over all levels
+        std::uint64_t deposits;
+    };
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Starts from the identity
+    MultigridSolver() {
+        for (std::size_t n = 0; n < N_COARSE-1; n++) {
+            initial_[n] = Float(n+1) / Float(N_COARSE);
+        }
+        std::random_device rd;
+        seed_ = (std::uint64_t(rd()) << 32) | std::uint64_t(rd());
+    }
+
+    // Takes an initial guess at the interior bin edges of any resolution,
+    // resampled to N_COARSE bins
+    template <typename std::size_t N_PTS>
+    MultigridSolver(std::array<Float, N_PTS> const & initial)
+        : MultigridSolver()
+    {
+        auto knots = PiecewiseLinearFunction<Float, N_COARSE>(initial)
+            .get_knots();
+        for (std::size_t n = 0; n < N_COARSE-1; n++) {
+            initial_[n] = knots[n+1];
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Configuration
+
+public:
+
+    // Deposits per iteration at the coarsest level, and the factor they grow
+    // by per level
+    void set_deposits(std::uint64_t const deposits, double const growth = 2) {
+        deposits_ = deposits;
+        growth_ = growth;
+    }
+
+    // Iterations at the coarsest level, and at each finer level (which
+    // starts close to its solution, so a few corrections are all it gets)
+    void set_max_iterations(std::size_t const coarse,
+            std::size_t const finer = 2) {
+        max_iterations_ = coarse;
+        finer_max_iterations_ = finer;
+    }
+
+    void set_damping(double const damping) {
+        damping_ = damping;
+    }
+
+    // Zero (the default) uses each level's own sampling noise
+    void set_tolerance(double const tolerance) {
+        tolerance_ = tolerance;
+    }
+
+    void set_seed(std::uint64_t const seed) {
+        seed_ = seed;
+    }
+
+    void set_threads(std::size_t const n_threads) {
+        n_threads_ = n_threads;
+    }
+
+    // Replay each level's first iteration in its later ones (keeping all of
+    // its tuples in memory)
+    void set_common_random_numbers(bool const common) {
+        common_ = common;
+    }
+
+    // ------------------------------------------------------------------------
+    // Levels
+
+private:
+
+    // Level of N bins (zero is the coarsest)
+    template <typename std::size_t N>
+    static constexpr std::size_t level_() {
+        if constexpr (N == N_COARSE) {
+            return 0;
+        } else {
+            return 1 + level_<N/2>();
+        }
+    }
+
+    // Solves at N bins, from the solution at N/2 bins
+    template <typename std::size_t N>
+    std::array<Float, N-1> solve_level_(Report & report) {
+        std::array<Float, N-1> initial;
+        if constexpr (N == N_COARSE) {
+            initial = initial_;
+        } else {
+            // (the half-resolution constructor)
+            auto knots = PiecewiseLinearFunction<Float, N>(
+                    solve_level_<N/2>(report)).get_knots();
+            for (std::size_t n = 0; n < N-1; n++) {
+                initial[n] = knots[n+1];
+            }
+        }
+
+        using Solver = InverseCDFSolver<deposit_all, Float, N_SUM, N, RNG>;
+        constexpr std::size_t level = level_<N>();
+        std::uint64_t deposits = deposits_;
+        for (std::size_t l = 0; l < level; l++) {
+            deposits = std::uint64_t(double(deposits) * growth_);
+        }
+        Solver solver(initial);
+        solver.set_seed(seed_ + level);
+        solver.set_damping(damping_);
+        solver.set_tolerance(tolerance_);
+        solver.set_max_iterations(level == 0 ? max_iterations_
+                : finer_max_iterations_);
+        solver.sampler().set_threads(n_threads_);
+        solver.sampler().set_stopping_rule(FixedCount(deposits));
+        if (common_) {
+            solver.set_common_random_numbers(
+                    Solver::Sampler::tuples_for(deposits));
+        }
+        auto result = solver.solve();
+
+        report.levels.push_back({N, result.iterations, result.converged,
+                result.rms_error, result.max_error,
+                result.iterations * deposits});
+        report.deposits += result.iterations * deposits;
+        return result.points;
+    }
+
+    // ------------------------------------------------------------------------
+    // Solve
+
+public:
+
+    Report solve() {
+        Report report;
+        report.deposits = 0;
+        report.points = solve_level_<N_BINS>(report);
+        return report;
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    // Initial guess at the coarsest level
+    std::array<Float, N_COARSE-1> initial_;
+
+    // Settings
+    std::uint64_t deposits_{1 << 16};
+    double growth_{2};
+    std::size_t max_iterations_{100};
+    std::size_t finer_max_iterations_{2};
+    double damping_{1.0};
+    double tolerance_{0};
+    std::uint64_t seed_;
+    std::size_t n_threads_{0};
+    bool common_{false};
+
+};
+
+#endif // MULTIGRID_SOLVER_HPP
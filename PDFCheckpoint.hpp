@@ -0,0 +1,370 @@
+#ifndef PDF_CHECKPOINT_HPP
+#define PDF_CHECKPOINT_HPP
+
+// Binary checkpoints of sampler output.
+//
+// A checkpoint holds the bin counts of the tuples [first_tuple, last_tuple)
+// of one run, with the run's metadata, so that a run can be resumed after it
+// dies and so that parts of a run sampled by different processes (see
+// ProbabilitySampler::sample_range) can be summed into the whole.
+//
+// File layout (native byte order; the magic, version and sizes are checked
+// on reading):
+// -- bytes [0, 128)  : CheckpointHeader, zero-padded
+// -- bytes [128, ...): n_bins counts, as std::uint64_t
+// The counts start at a fixed, aligned offset, so a checkpoint can be mapped
+// and read in place (MappedCheckpoint) however large it is.
+//
+// Files are written to a temporary name, synced and then renamed, so a
+// process killed while writing leaves the previous checkpoint intact.
+
+#include "SamplerHooks.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ============================================================================
+// Metadata
+
+// (CheckpointInfo is in SamplerHooks.hpp)
+struct CheckpointHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t header_bytes;
+    std::uint64_t n_bins;
+    std::uint64_t count;
+    std::uint32_t n_sum;
+    std::uint32_t deposit_all;
+    std::uint64_t seed;
+    std::uint64_t stream;
+    std::uint64_t inverse_cdf_hash;
+    std::uint64_t first_tuple;
+    std::uint64_t last_tuple;
+    // Zero (independent) in files from before the sampling modes
+    std::uint32_t sampling_mode;
+};
+
+namespace pdf_checkpoint_ {
+
+constexpr char MAGIC[8] = {'N', 'R', 'D', 'P', 'D', 'F', '\0', '\0'};
+constexpr std::uint32_t VERSION = 1;
+constexpr std::size_t HEADER_BYTES = 128;
+
+static_assert(sizeof(CheckpointHeader) <= HEADER_BYTES,
+        "checkpoint header too large");
+
+// PDFs with a run-time number of bins
+template <typename PDF, typename = void>
+struct is_resizable : std::false_type {};
+
+template <typename PDF>
+struct is_resizable<PDF, std::void_t<decltype(
+        std::declval<PDF &>().resize(std::size_t{}))>> : std::true_type {};
+
+inline CheckpointInfo info(CheckpointHeader const & h) {
+    return {h.deposit_all != 0, std::size_t(h.n_sum), h.seed, h.stream,
+        h.inverse_cdf_hash, std::size_t(h.first_tuple),
+        std::size_t(h.last_tuple), h.sampling_mode};
+}
+
+inline void write_all(int const fd, void const * data, std::size_t bytes,
+        std::string const & path) {
+    auto p = static_cast<char const *>(data);
+    while (bytes > 0) {
+        ssize_t n = ::write(fd, p, bytes);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(),
+                    "checkpoint: write " + path);
+        }
+        p += n;
+        bytes -= std::size_t(n);
+    }
+}
+
+// Writes a header and counts to path (through a temporary file)
+inline void write(std::string const & path, CheckpointInfo const & info,
+        std::uint64_t const count, std::uint64_t const * counts,
+        std::size_t const n_bins) {
+    char header[HEADER_BYTES] = {};
+    CheckpointHeader h;
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.header_bytes = HEADER_BYTES;
+    h.n_bins = n_bins;
+    h.count = count;
+    h.n_sum = std::uint32_t(info.n_sum);
+    h.deposit_all = info.deposit_all ? 1 : 0;
+    h.seed = info.seed;
+    h.stream = info.stream;
+    h.inverse_cdf_hash = info.inverse_cdf_hash;
+    h.first_tuple = info.first_tuple;
+    h.last_tuple = info.last_tuple;
+    h.sampling_mode = info.sampling_mode;
+    std::memcpy(header, &h, sizeof(h));
+
+    std::string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(),
+                "checkpoint: open " + temp);
+    }
+    write_all(fd, header, HEADER_BYTES, temp);
+    write_all(fd, counts, n_bins * sizeof(std::uint64_t), temp);
+    if (::fsync(fd) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(),
+                "checkpoint: sync " + temp);
+    }
+    ::close(fd);
+    if (::rename(temp.c_str(), path.c_str()) != 0) {
+        throw std::system_error(errno, std::generic_category(),
+                "checkpoint: rename " + temp);
+    }
+}
+
+} // end namespace pdf_checkpoint_
+
+// ============================================================================
+// A checkpoint file mapped read-only into memory
+
+class MappedCheckpoint {
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Maps the file; throws std::system_error if it cannot be read and
+    // std::runtime_error if it is not a checkpoint of this version.
+    explicit MappedCheckpoint(std::string const & path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                    "checkpoint: open " + path);
+        }
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(),
+                    "checkpoint: stat " + path);
+        }
+        bytes_ = std::size_t(st.st_size);
+        if (bytes_ < pdf_checkpoint_::HEADER_BYTES) {
+            ::close(fd);
+            throw std::runtime_error("checkpoint: " + path + " is too short");
+        }
+        void * p = ::mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd, 0);
+        int err = errno;
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            throw std::system_error(err, std::generic_category(),
+                    "checkpoint: map " + path);
+        }
+        data_ = static_cast<char const *>(p);
+        std::memcpy(&header_, data_, sizeof(header_));
+        if (std::memcmp(header_.magic, pdf_checkpoint_::MAGIC,
+                    sizeof(pdf_checkpoint_::MAGIC)) != 0
+                || header_.version != pdf_checkpoint_::VERSION
+                || header_.header_bytes != pdf_checkpoint_::HEADER_BYTES
+                || bytes_ != pdf_checkpoint_::HEADER_BYTES
+                    + header_.n_bins * sizeof(std::uint64_t)) {
+            ::munmap(const_cast<char *>(data_), bytes_);
+            throw std::runtime_error("checkpoint: " + path
+                    + " is not a version 1 checkpoint");
+        }
+    }
+
+    MappedCheckpoint(MappedCheckpoint const &) = delete;
+    MappedCheckpoint & operator=(MappedCheckpoint const &) = delete;
+
+    ~MappedCheckpoint() {
+        ::munmap(const_cast<char *>(data_), bytes_);
+    }
+
+    // ------------------------------------------------------------------------
+    // Access
+
+public:
+
+    CheckpointInfo info() const {
+        return pdf_checkpoint_::info(header_);
+    }
+
+    std::size_t n_bins() const {
+        return std::size_t(header_.n_bins);
+    }
+
+    std::uint64_t count() const {
+        return header_.count;
+    }
+
+    // The bin counts, in place
+    std::uint64_t const * counts() const {
+        return reinterpret_cast<std::uint64_t const *>(
+                data_ + pdf_checkpoint_::HEADER_BYTES);
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    char const * data_{nullptr};
+    std::size_t bytes_{0};
+    CheckpointHeader header_;
+
+};
+
+// ============================================================================
+// Read and write PDFs
+
+// Does a checkpoint exist at path?
+inline bool checkpoint_exists(std::string const & path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0;
+}
+
+// Writes the counts of pdf (a BinnedPDF or DynamicBinnedPDF with integral
+// counters) with the given metadata.
+template <typename PDF>
+void write_checkpoint(std::string const & path, PDF const & pdf,
+        CheckpointInfo const & info) {
+    auto const & bins = pdf.get_all_bins();
+    std::vector<std::uint64_t> counts(bins.begin(), bins.end());
+    pdf_checkpoint_::write(path, info, std::uint64_t(pdf.count()),
+            counts.data(), counts.size());
+}
+
+// Replaces the counts of pdf with those of a checkpoint and returns its
+// metadata.  A fixed-size pdf must have the checkpoint's number of bins; a
+// DynamicBinnedPDF is resized.
+template <typename PDF>
+CheckpointInfo read_checkpoint(std::string const & path, PDF & pdf) {
+    MappedCheckpoint file(path);
+    if constexpr (pdf_checkpoint_::is_resizable<PDF>::value) {
+        if (pdf.n_bins() != file.n_bins()) {
+            pdf.resize(file.n_bins());
+        }
+    }
+    if (pdf.n_bins() != file.n_bins()) {
+        throw std::runtime_error("checkpoint: " + path + " has "
+                + std::to_string(file.n_bins()) + " bins, expected "
+                + std::to_string(pdf.n_bins()));
+    }
+    pdf.clear();
+    std::uint64_t const * counts = file.counts();
+    for (std::size_t n = 0; n < file.n_bins(); n++) {
+        pdf.add_to_bin(n, counts[n]);
+    }
+    return file.info();
+}
+
+// A checkpoint file as a sampler's store (see
+// ProbabilitySampler::set_checkpoint)
+template <typename PDF>
+class CheckpointFile : public CheckpointStore<PDF> {
+
+public:
+
+    explicit CheckpointFile(std::string path)
+        : path_(std::move(path))
+    {}
+
+    bool exists() const override {
+        return checkpoint_exists(path_);
+    }
+
+    CheckpointInfo read(PDF & pdf) const override {
+        return read_checkpoint(path_, pdf);
+    }
+
+    void write(PDF const & pdf, CheckpointInfo const & info) override {
+        write_checkpoint(path_, pdf, info);
+    }
+
+    std::string const & name() const override {
+        return path_;
+    }
+
+private:
+
+    std::string path_;
+
+};
+
+// ============================================================================
+// Merge
+
+// Sums checkpoints of disjoint parts of one run into a checkpoint of their
+// union.  Throws std::runtime_error unless all inputs have the same bins and
+// run metadata (deposit mode, N_SUM, seed, stream, inverse CDF, sampling
+// mode) and their tuple ranges tile one range without overlaps or gaps.
+inline CheckpointInfo merge_checkpoints(std::vector<std::string> const & inputs,
+        std::string const & output) {
+    if (inputs.empty()) {
+        throw std::runtime_error("checkpoint: nothing to merge");
+    }
+    std::vector<std::uint64_t> sum;
+    std::uint64_t count = 0;
+    CheckpointInfo merged{};
+    std::vector<std::pair<std::size_t, std::size_t>> ranges;
+    for (std::size_t i = 0; i < inputs.size(); i++) {
+        MappedCheckpoint file(inputs[i]);
+        CheckpointInfo info = file.info();
+        if (i == 0) {
+            merged = info;
+            sum.assign(file.n_bins(), 0);
+        } else if (file.n_bins() != sum.size()
+                || info.deposit_all != merged.deposit_all
+                || info.n_sum != merged.n_sum
+                || info.seed != merged.seed
+                || info.stream != merged.stream
+                || info.inverse_cdf_hash != merged.inverse_cdf_hash
+                || info.sampling_mode != merged.sampling_mode) {
+            throw std::runtime_error("checkpoint: " + inputs[i]
+                    + " is from a different run than " + inputs[0]);
+        }
+        std::uint64_t const * counts = file.counts();
+        for (std::size_t n = 0; n < sum.size(); n++) {
+            sum[n] += counts[n];
+        }
+        count += file.count();
+        ranges.emplace_back(info.first_tuple, info.last_tuple);
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for (std::size_t i = 1; i < ranges.size(); i++) {
+        if (ranges[i].first != ranges[i-1].second) {
+            throw std::runtime_error("checkpoint: tuple ranges "
+                    + std::string(ranges[i].first < ranges[i-1].second
+                        ? "overlap" : "leave a gap")
+                    + " at tuple " + std::to_string(ranges[i-1].second));
+        }
+    }
+    merged.first_tuple = ranges.front().first;
+    merged.last_tuple = ranges.back().second;
+    pdf_checkpoint_::write(output, merged, count, sum.data(), sum.size());
+    return merged;
+}
+
+#endif // PDF_CHECKPOINT_HPP
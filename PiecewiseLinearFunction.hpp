@@ -1,8 +1,12 @@
 #ifndef PIECEWISE_LINEAR_FUNCTION_HPP
 #define PIECEWISE_LINEAR_FUNCTION_HPP
 
+#include "CPUDispatch.hpp"
+
 #include <array>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
 #include <type_traits>
 
 // ============================================================================
@@ -36,6 +40,57 @@ constexpr bool R_other_(
     return !R_exact_(N_PTS,N_BINS) && !R_half_(N_PTS,N_BINS);
 }
 
+// ============================================================================
+// Batch evaluation kernels
+// -- Dispatched to the best instruction set the CPU supports (see
+//    CPUDispatch.hpp).  With separate slope and intercept arrays the loads
+//    become vector gathers.
+// -- The arithmetic is the same multiply-then-add as the scalar path, so
+//    results are identical to operator().
+// -- The run-time sized DynamicPiecewiseLinearFunction uses the same loop,
+//    with the number of bins as an argument.
+
+namespace piecewise_linear_function_ {
+
+template <typename Float>
+inline __attribute__((always_inline))
+void evaluate(Float const * __restrict slopes,
+        Float const * __restrict intercepts,
+        Float const * __restrict in, Float * __restrict out,
+        std::size_t const n, Float const scale) {
+    for (std::size_t i = 0; i < n; i++) {
+        Float x = in[i];
+        std::int32_t index = std::int32_t(x * scale);
+        out[i] = slopes[index] * x + intercepts[index];
+    }
+}
+
+// N_BINS bins
+template <typename Float, std::size_t N_BINS>
+struct Evaluate {
+    static inline __attribute__((always_inline))
+    void run(Float const * __restrict slopes,
+            Float const * __restrict intercepts,
+            Float const * __restrict in, Float * __restrict out,
+            std::size_t const n) {
+        evaluate(slopes, intercepts, in, out, n, Float(N_BINS));
+    }
+};
+
+// n_bins bins
+template <typename Float>
+struct EvaluateDynamic {
+    static inline __attribute__((always_inline))
+    void run(Float const * __restrict slopes,
+            Float const * __restrict intercepts,
+            Float const * __restrict in, Float * __restrict out,
+            std::size_t const n, std::size_t const n_bins) {
+        evaluate(slopes, intercepts, in, out, n, Float(n_bins));
+    }
+};
+
+} // end namespace piecewise_linear_function_
+
 // ============================================================================
 
 template <typename Float, typename std::size_t N_BINS>
@@ -46,13 +101,10 @@ class PiecewiseLinearFunction {
 
 private:
 
-    // Coefficients
-    using CoefficientPair = std::array<Float, 2>;
-    std::array<CoefficientPair, N_BINS> coefficients_;
-
-    // Indices
-    static constexpr int SLOPE_ = 0;
-    static constexpr int INTERCEPT_ = 1;
+    // Coefficients (y = m x + b), stored as separate arrays for the batch
+    // kernels
+    std::array<Float, N_BINS> slopes_;
+    std::array<Float, N_BINS> intercepts_;
 
     // ------------------------------------------------------------------------
 
@@ -83,8 +135,8 @@ private:
             // Compute coefficients for y = m x + b
             Float m = (y1 - y0) / (x1 - x0);
             Float b = y1 - m * x1;
-            coefficients_[n][SLOPE_] = m;
-            coefficients_[n][INTERCEPT_] = b;
+            slopes_[n] = m;
+            intercepts_[n] = b;
         }
     }
 
@@ -158,27 +210,49 @@ public:
 
     static auto get_bin_edges() {
         std::array<Float, N_BINS-1> bin_edges;
-        for (int n = 0; n < N_BINS; n++) {
+        for (int n = 0; n < N_BINS-1; n++) {
             bin_edges[n] = bin_edge_(n+1);
         }
         return bin_edges;
     }
 
+    // ------------------------------------------------------------------------
+    // Get the function values at all bin edges, including (0,0) and (1,1)
+
+public:
+
+    auto get_knots() const {
+        std::array<Float, N_BINS+1> knots;
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            knots[n] = slopes_[n] * bin_edge_(n) + intercepts_[n];
+        }
+        knots[N_BINS] = slopes_[N_BINS-1] + intercepts_[N_BINS-1];
+        return knots;
+    }
+
     // ------------------------------------------------------------------------
     // Call operator to evaluate function
 
 public:
 
-    auto operator() (Float const & x) {
+    auto operator() (Float const & x) const {
         assert(x >= Float{0});
         assert(x <  Float{1});
         std::size_t index = std::size_t(x * N_BINS);
-        auto & coefs = coefficients_[index];
-        auto & m = coefs[SLOPE_];
-        auto & b = coefs[INTERCEPT_];
+        auto const & m = slopes_[index];
+        auto const & b = intercepts_[index];
         return m * x + b;
     }
 
+    // Evaluates the function at in[0..n) and writes the results to out[0..n)
+    // -- Identical to calling operator() on each point.
+    // -- All inputs must be in [0,1).
+    // -- in and out must not overlap.
+    void evaluate(Float const * in, Float * out, std::size_t const n) const {
+        get_kernel<piecewise_linear_function_::Evaluate<Float, N_BINS>>()(
+                slopes_.data(), intercepts_.data(), in, out, n);
+    }
+
 };
 
 #endif // PIECEWISE_LINEAR_FUNCTION_HPP
@@ -2,47 +2,102 @@
 #define PROBABILITY_SAMPLER_HPP
 
 // TODO
-// -- Template on the RNG.  Then I can provide a fake "random" number generator
-//    that just provides edge-case values to reliably demonstrate whether or
-//    not it works as expected.
-// -- Make generic on the type of the inverse CDF.  It just needs to be
-//    callable, which would allow, e.g., an analytic inverse CDF.
 // -- Would it make sense to collapse this into one or more free functions?
 
 #include "BinnedPDF.hpp"
+#include "HistogramLayouts.hpp"
+#include "InverseCDF.hpp"
 #include "PiecewiseLinearFunction.hpp"
+#include "RNGPolicies.hpp"
+#include "SamplerHooks.hpp"
+#include "SamplerStats.hpp"
+#include "SamplingModes.hpp"
+#include "StoppingRules.hpp"
+#include "UniformCache.hpp"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <optional>
 #include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <type_traits>
+#include <vector>
 
 // ============================================================================
+// Chunking
+// -- The samples are drawn in fixed-size chunks of tuples, and chunk c always
+//    gets the same random numbers (see ProbabilitySampler::make_chunk_engine_).
+//    The result therefore depends only on the seed, stream and stopping rule,
+//    not on how many threads share out the chunks.
+// -- Chunks are drawn in blocks of tuples small enough to stay in cache.
+// -- Shared with the run-time sampler (DynamicProbabilitySampler), whose runs
+//    must match these bit for bit.
 
-namespace {
+namespace probability_sampler_ {
 
-// Get the RNG based on the type of Float
-template <typename Float_t>
-auto get_rng_engine_();
+constexpr std::size_t CHUNK_TUPLES = 1 << 14;
+constexpr std::size_t BLOCK_TUPLES = 1 << 10;
 
-// single-precision
-template <>
-auto get_rng_engine_<float>() {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    return gen;
+} // end namespace probability_sampler_
+
+// ============================================================================
+// Nudges by one ulp
+// -- Branch-free std::nextafter for the sampler's values: for finite x >= 0
+//    the neighboring representable values are the neighboring bit patterns.
+//    Other floating-point types fall back to std::nextafter.
+
+namespace probability_sampler_ {
+
+template <typename Float>
+using Bits = std::conditional_t<sizeof(Float) == 4, std::uint32_t,
+      std::uint64_t>;
+
+template <typename Float>
+constexpr bool BIT_NUDGES = std::is_same_v<Float, float>
+    || std::is_same_v<Float, double>;
+
+// std::nextafter(x, 1) for finite x >= 0
+template <typename Float>
+inline Float toward_one(Float const x) {
+    if constexpr (BIT_NUDGES<Float>) {
+        Bits<Float> b;
+        std::memcpy(&b, &x, sizeof(Float));
+        b = b + Bits<Float>(x < Float{1}) - Bits<Float>(x > Float{1});
+        Float y;
+        std::memcpy(&y, &b, sizeof(Float));
+        return y;
+    } else {
+        return std::nextafter(x, Float{1});
+    }
 }
 
-// double-precision
-template <>
-auto get_rng_engine_<double>() {
-    std::random_device rd;
-    std::mt19937_64 gen(rd());
-    return gen;
+// std::nextafter(x, 0) for finite x >= 0
+template <typename Float>
+inline Float toward_zero(Float const x) {
+    if constexpr (BIT_NUDGES<Float>) {
+        Bits<Float> b;
+        std::memcpy(&b, &x, sizeof(Float));
+        b -= Bits<Float>(x > Float{0});
+        Float y;
+        std::memcpy(&y, &b, sizeof(Float));
+        return y;
+    } else {
+        return std::nextafter(x, Float{0});
+    }
 }
 
-} // end namespace
+} // end namespace probability_sampler_
 
 // ============================================================================
 
@@ -50,9 +105,17 @@ template <
     bool deposit_all,
     typename Float,
     typename std::size_t N_SUM,
-    typename std::size_t N_BINS>
+    typename std::size_t N_BINS,
+    typename RNG = MersenneTwisterRNG<Float>,
+    typename Counter = std::uint64_t,
+    typename Layout = ShardedHistogram,
+    typename InverseCDF = PiecewiseLinearFunction<Float, N_BINS>>
 class ProbabilitySampler {
 
+    static_assert(rng_dimension_<RNG>::value == 0
+            || rng_dimension_<RNG>::value == N_SUM,
+            "quasi-random RNG dimension must equal N_SUM");
+
     // ------------------------------------------------------------------------
     // Constructors
 
@@ -61,42 +124,106 @@ public:
     // Default-constructs the object (mostly for testing).
     //ProbabilitySampler() = default;
 
-    // Takes inverse CDF
+    // Takes inverse CDF (anything InverseCDF can be made from; see
+    // InverseCDF.hpp for what InverseCDF itself may be)
     template <typename Function>
     ProbabilitySampler(Function && inverse_cdf)
-        : inverse_cdf_(inverse_cdf)
-        , uniform_(Float{0}, Float{1})
+        : inverse_cdf_(std::forward<Function>(inverse_cdf))
     {
     }
 
     // ------------------------------------------------------------------------
-    // Continue condition -- how long to keep sampling?
+    // Types
 
 private:
 
-    bool continue_condition_(BinnedPDF<Float, int, N_BINS> const & pdf) {
-        constexpr int N_ITER = 1000000;
-        return pdf.count() < N_ITER;
-    }
+    // 64-bit counters by default: 32-bit ones overflow after about 2^31
+    // deposits.
+    using PDF_ = BinnedPDF<Float, Counter, N_BINS>;
+    using Engine_ = typename RNG::engine_type;
+
+    // A worker's private PDF (ShardedHistogram), on cache lines of its own
+    struct alignas(64) Shard_ {
+        PDF_ pdf;
+    };
+
+public:
+
+    // Output PDF type
+    using PDF = PDF_;
+
+    // Stopping rule (see StoppingRules.hpp)
+    using StoppingRule = std::function<std::size_t(PDF_ const &)>;
+
+    // Stored uniforms for common random numbers (see UniformCache.hpp)
+    using Cache = UniformCache<Float, N_SUM>;
+
+    // Streams the normalized tuples to a file (see SampleExporter.hpp)
+    using Exporter = SampleExporter<Float, N_SUM>;
+
+    // Work space for sample_range
+    using Buffer = std::vector<Float>;
+
+    // ------------------------------------------------------------------------
+    // Chunking
+
+private:
+
+    // (see probability_sampler_)
+    static constexpr std::size_t CHUNK_TUPLES_ =
+        probability_sampler_::CHUNK_TUPLES;
+    static constexpr std::size_t BLOCK_TUPLES_ =
+        probability_sampler_::BLOCK_TUPLES;
+
+    // Deposits made per tuple
+    static constexpr std::size_t PER_TUPLE_ = deposit_all ? N_SUM : 1;
 
     // ------------------------------------------------------------------------
     // Initialize / reset the random number generator data
 
 private:
 
+    // Fix the seed and stream for the current call to generate().  Without a
+    // user-supplied seed, every call draws a fresh one.  A cache that has
+    // recorded a run overrides both, so the run is replayed.
     auto set_up_rng_() {
-        engine_ = get_rng_engine_<Float>();
-        uniform_.reset();
+        if (seed_) {
+            current_seed_ = *seed_;
+        } else {
+            std::random_device rd;
+            current_seed_ = (std::uint64_t(rd()) << 32) | std::uint64_t(rd());
+        }
+        current_stream_ = stream_.value_or(0);
+        if (cache_) {
+            if (cache_->bound()) {
+                current_seed_ = cache_->seed();
+                current_stream_ = cache_->stream();
+            } else {
+                cache_->bind(current_seed_, current_stream_);
+            }
+        }
+    }
+
+    // Engine positioned at the start of a chunk
+    // -- Seekable RNGs treat the whole run as one sequence on the stream and
+    //    jump to the chunk's offset.
+    // -- Other RNGs get an independent stream per chunk.
+    Engine_ make_chunk_engine_(std::size_t const chunk) const {
+        if constexpr (RNG::seekable) {
+            auto engine = RNG::make_engine(current_seed_, current_stream_);
+            RNG::skip(engine, std::uint64_t(chunk) * CHUNK_TUPLES_ * N_SUM);
+            return engine;
+        } else {
+            return RNG::make_engine(current_seed_, (current_stream_ << 32) ^ chunk);
+        }
     }
 
     // ------------------------------------------------------------------------
-    // Generate a random number drawn from the input distribution
+    // Clean up a random number drawn from the input distribution
 
 private:
 
-    auto generate_random_number() {
-        auto y = uniform_(engine_);
-        auto x = inverse_cdf_(y);
+    auto clamp_random_number_(Float x) const {
         // If all values are zero (very unlikely but not impossible), then
         // we'll end up with a division-by-zero error in the normalization
         // step.  This forces all values to be in the range of (0,1] (we'll
@@ -104,7 +231,10 @@ private:
         // bias, but it should be much smaller than any practically-possible
         // error (likely on par with the biases we already have because they
         // are inherent in using finite-precision floating-point values).
-        x = std::nextafter(x, Float{1});
+        // Values are also kept at or above the smallest normal number: the
+        // sum of N_SUM denormals has a reciprocal that overflows to infinity.
+        x = probability_sampler_::toward_one(x);
+        x = std::max(x, std::numeric_limits<Float>::min());
         return x;
     }
 
@@ -113,11 +243,18 @@ private:
 
 private:
 
-    auto generate_normalized_values_() {
+    // Takes the N_SUM values drawn from the input distribution for this tuple.
+    // Returns the values to deposit, or with all the whole tuple.  Counts
+    // the edge cases into counters (see SamplerStats.hpp), if given.
+    template <bool all = deposit_all>
+    auto generate_normalized_values_(Float const * drawn,
+            ThreadCounters * counters = nullptr) const {
         std::array<Float, N_SUM> values;
         Float sum{0};
         for (auto & x : values) {
-            x = generate_random_number();
+            sampler_stats_::add(counters, &ThreadCounters::zero_draws,
+                    *drawn < std::numeric_limits<Float>::min());
+            x = clamp_random_number_(*drawn++);
             sum += x;
         }
         // If N_SUM == 1, we're just testing the how sampling from the input
@@ -139,22 +276,63 @@ private:
         // we already have because they are inherent in using finite-precision
         // floating-point values).
         for (auto & x : values) {
-            x = std::nextafter(x, Float{0});
+            sampler_stats_::add(counters, &ThreadCounters::unit_values,
+                    x >= Float{1});
+            x = probability_sampler_::toward_zero(x);
         }
-        if constexpr (deposit_all) {
+        if constexpr (all) {
             return values;
         } else {
             return values[0];
         }
     }
 
+    // The same for the n tuples at drawn, in one pass with no per-tuple
+    // arrays: writes the whole tuple (with all) or its first value to out.
+    template <bool all = deposit_all>
+    void normalize_block_(Float const * __restrict drawn,
+            Float * __restrict out, std::size_t const n,
+            ThreadCounters * counters = nullptr) const {
+        constexpr std::size_t N_OUT = all ? N_SUM : 1;
+        for (std::size_t t = 0; t < n; t++, drawn += N_SUM, out += N_OUT) {
+            Float first = clamp_random_number_(drawn[0]);
+            Float sum = first;
+            out[0] = first;
+            for (std::size_t i = 1; i < N_SUM; i++) {
+                Float x = clamp_random_number_(drawn[i]);
+                sum += x;
+                if constexpr (all) {
+                    out[i] = x;
+                }
+            }
+            Float denom = N_SUM > 1 ? Float{1} / sum : Float{1};
+            for (std::size_t i = 0; i < N_OUT; i++) {
+                Float x = N_SUM > 1 ? out[i] * denom : out[i];
+                sampler_stats_::add(counters, &ThreadCounters::unit_values,
+                        x >= Float{1});
+                out[i] = probability_sampler_::toward_zero(x);
+            }
+            if constexpr (sampler_stats_::ENABLED) {
+                for (std::size_t i = 0; i < N_SUM; i++) {
+                    sampler_stats_::add(counters, &ThreadCounters::zero_draws,
+                            drawn[i] < std::numeric_limits<Float>::min());
+                }
+                // (the values not written still count)
+                for (std::size_t i = N_OUT; i < N_SUM; i++) {
+                    sampler_stats_::add(counters, &ThreadCounters::unit_values,
+                            clamp_random_number_(drawn[i]) * denom >= Float{1});
+                }
+            }
+        }
+    }
+
     // ------------------------------------------------------------------------
     // Deposit the normalized random number(s) to the output PDF
 
 private:
 
     template <typename Value>
-    void deposit_values_(Value && v, BinnedPDF<Float, int, N_BINS> & pdf) {
+    void deposit_values_(Value && v, PDF_ & pdf) const {
         if constexpr (deposit_all) {
             for (auto & x : v) {
                 pdf.deposit(x);
@@ -164,27 +342,784 @@ private:
         }
     }
 
+    // ------------------------------------------------------------------------
+    // Engine positioned at the first of a range of tuples lying within one
+    // chunk
+
+private:
+
+    // No engine is needed (nullopt) if the piece is replayed from the cache.
+    std::optional<Engine_> make_piece_engine_(std::size_t const first,
+            std::size_t const last, std::vector<Float> & buffer) const {
+        std::size_t chunk = first / CHUNK_TUPLES_;
+        assert(last <= (chunk + 1) * CHUNK_TUPLES_);
+        buffer.resize(2 * BLOCK_TUPLES_ * N_SUM + BLOCK_TUPLES_ * PER_TUPLE_);
+        if (cache_ && last <= cache_->recorded()) {
+            return std::nullopt;
+        }
+        auto engine = make_chunk_engine_(chunk);
+        // Advance to the first tuple (only happens when a round of the
+        // stopping rule ends partway through a chunk)
+        std::size_t offset = first - chunk * CHUNK_TUPLES_;
+        if constexpr (RNG::seekable) {
+            RNG::skip(engine, std::uint64_t(offset) * N_SUM);
+        } else {
+            while (offset > 0) {
+                std::size_t n_block = std::min(BLOCK_TUPLES_, offset);
+                fill_uniforms<RNG>(engine, buffer.data(), n_block * N_SUM);
+                offset -= n_block;
+            }
+        }
+        return engine;
+    }
+
+    // Uniforms for the tuples [n, n + n_block) of a piece
+    // -- Replayed pieces read them from the cache.
+    // -- Pieces within the cache's capacity draw them into the cache.
+    // -- Others draw them into the first half of the buffer.
+    Float const * draw_block_(std::optional<Engine_> & engine,
+            std::size_t const n, std::size_t const n_block,
+            std::vector<Float> & buffer) const {
+        if (!engine) {
+            return cache_->tuple(n);
+        }
+        Float * out = buffer.data();
+        if (cache_ && n + n_block <= cache_->capacity()) {
+            out = cache_->tuple(n);
+        }
+        fill_uniforms<RNG>(*engine, out, n_block * N_SUM);
+        return out;
+    }
+
+    // The uniforms of draw_block_, rewritten by the sampling mode (into the
+    // first part of the buffer; see SamplingModes.hpp)
+    Float const * draw_tuples_(std::optional<Engine_> & engine,
+            std::size_t const n, std::size_t const n_block,
+            std::vector<Float> & buffer) const {
+        Float const * u = draw_block_(engine, n, n_block, buffer);
+        if (mode_ == SamplingMode::independent) {
+            return u;
+        }
+        sampling_modes_::apply<Float, N_SUM, N_BINS>(mode_, u, buffer.data(),
+                n, n_block, sampling_modes_::mix(current_seed_
+                    ^ sampling_modes_::mix(current_stream_)));
+        return buffer.data();
+    }
+
+    // First tuple to draw for a piece starting at first: the start of its
+    // group of the sampling mode
+    std::size_t group_start_(std::size_t const first) const {
+        return first - first % sampling_modes_::group(mode_);
+    }
+
+    // Split the tuples [first, last) at chunk boundaries, and at the ends of
+    // the recorded and recordable parts of the cache
+    auto split_pieces_(std::size_t const first, std::size_t const last) const {
+        std::vector<std::array<std::size_t, 2>> pieces;
+        for (std::size_t n = first; n < last; ) {
+            std::size_t end = std::min(last, (n / CHUNK_TUPLES_ + 1) * CHUNK_TUPLES_);
+            if (cache_) {
+                for (std::size_t split : {cache_->recorded(), cache_->capacity()}) {
+                    if (n < split && split < end) {
+                        end = split;
+                    }
+                }
+            }
+            pieces.push_back({n, end});
+            n = end;
+        }
+        return pieces;
+    }
+
+    // Everything up to tuple n_tuples has been drawn, so the cache holds
+    // that much of the run.
+    void update_cache_(std::size_t const n_tuples) {
+        if (cache_) {
+            cache_->set_recorded(std::min(n_tuples, cache_->capacity()));
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Export the normalized tuples (see set_exporter)
+
+private:
+
+    // Normalizes the n_block tuples of x starting at tuple n into a block of
+    // the exporter, collects the values to deposit in d, and hands the block
+    // to the exporter's writer.
+    void export_block_(std::size_t const n, std::size_t const n_block,
+            Float const * x, Float * d, ThreadCounters * counters) const {
+        auto block = exporter_->acquire();
+        normalize_block_<true>(x, block.tuples, n_block, counters);
+        if constexpr (deposit_all) {
+            std::copy(block.tuples, block.tuples + n_block * N_SUM, d);
+        } else {
+            for (std::size_t t = 0; t < n_block; t++) {
+                d[t] = block.tuples[t * N_SUM];
+            }
+        }
+        exporter_->submit(block, n, n_block);
+    }
+
+    // ------------------------------------------------------------------------
+    // Sample a range of tuples lying within one chunk into a PDF
+
+private:
+
+    // -- The uniforms are drawn a block at a time (see draw_block_) so that
+    //    block-capable RNGs (see fill_uniforms) can generate them with SIMD
+    //    code.  The inverse CDF is applied to the whole block (into the second
+    //    part of the buffer).
+    // -- The whole block is then normalized in one pass (see
+    //    normalize_block_), straight into the third part of the buffer, and
+    //    deposited with one call to deposit_batch, which keeps large
+    //    histograms cache-friendly.
+    // -- With shared, other threads deposit into the same PDF (see
+    //    AtomicHistogram).
+    // -- With counters, the tuples, edge cases and time per phase are counted
+    //    into them (see SamplerStats.hpp).
+    // -- Tuples before first drawn only to complete a group of the sampling
+    //    mode (see group_start_) are skipped.
+    // -- Histogram is PDF_, or a DynamicBinnedPDF of N_BINS bins (see
+    //    sample_range).
+    template <typename Histogram>
+    void sample_piece_(std::size_t const first, std::size_t const last,
+            Histogram & pdf, std::vector<Float> & buffer,
+            bool const shared = false,
+            ThreadCounters * counters = nullptr) const {
+        std::size_t start = group_start_(first);
+        auto engine = make_piece_engine_(start, last, buffer);
+        Float * x_block = buffer.data() + BLOCK_TUPLES_ * N_SUM;
+        Float * d_block = buffer.data() + 2 * BLOCK_TUPLES_ * N_SUM;
+        for (std::size_t n = start; n < last; n += BLOCK_TUPLES_) {
+            std::size_t n_block = std::min(BLOCK_TUPLES_, last - n);
+            std::size_t skip = n < first ? first - n : 0;
+            std::uint64_t tick = sampler_stats_::start(counters);
+            Float const * u = draw_tuples_(engine, n, n_block, buffer);
+            sampler_stats_::lap(counters, &ThreadCounters::draw_ticks, tick);
+            inverse_cdfs_::evaluate(inverse_cdf_, u, x_block, n_block * N_SUM);
+            sampler_stats_::lap(counters, &ThreadCounters::inverse_cdf_ticks,
+                    tick);
+            Float const * x = x_block + skip * N_SUM;
+            n_block -= skip;
+            if (exporter_) {
+                export_block_(n + skip, n_block, x, d_block, counters);
+            } else {
+                normalize_block_(x, d_block, n_block, counters);
+            }
+            sampler_stats_::lap(counters, &ThreadCounters::normalize_ticks,
+                    tick);
+            if (shared) {
+                pdf.deposit_batch_atomic(d_block, n_block * PER_TUPLE_);
+            } else {
+                pdf.deposit_batch(d_block, n_block * PER_TUPLE_);
+            }
+            sampler_stats_::lap(counters, &ThreadCounters::deposit_ticks, tick);
+            sampler_stats_::add(counters, &ThreadCounters::tuples, n_block);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Sample the tuples [first, last) into a PDF
+
+private:
+
+    // One piece on worker t; with set_batch_variance, through the worker's
+    // batch PDF so that pdf can estimate its variance (see
+    // BinnedPDF::add_batch)
+    void sample_batch_(std::array<std::size_t, 2> const & piece, PDF_ & pdf,
+            std::size_t const t, bool const shared) {
+        if (!batch_variance_) {
+            sample_piece_(piece[0], piece[1], pdf, buffers_[t], shared,
+                    counters_(t));
+            return;
+        }
+        PDF_ & batch = batches_[t].pdf;
+        batch.clear();
+        sample_piece_(piece[0], piece[1], batch, buffers_[t], false,
+                counters_(t));
+        pdf.add_batch(batch);
+    }
+
+    void sample_tuples_(std::size_t const first, std::size_t const last,
+            PDF_ & pdf) {
+        auto pieces = split_pieces_(first, last);
+        std::size_t n_threads = n_threads_;
+        if (n_threads == 0) {
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        n_threads = std::min(n_threads, pieces.size());
+        if (buffers_.size() < n_threads) {
+            buffers_.resize(n_threads);
+        }
+        if (sampler_stats_::ENABLED && stats_run_.threads.size() < n_threads) {
+            stats_run_.threads.resize(n_threads);
+        }
+        if (batch_variance_ && batches_.size() < n_threads) {
+            batches_.resize(n_threads);
+        }
+        if (n_threads <= 1) {
+            for (auto const & piece : pieces) {
+                sample_batch_(piece, pdf, 0, false);
+            }
+            return;
+        }
+        // Each worker claims pieces from a shared counter and deposits into
+        // its own shard (summed at the end) or straight into pdf, depending
+        // on the layout.  (Batches for the variance always go through
+        // shards.)
+        bool shared = Layout::shared && !batch_variance_;
+        if (!shared && shards_.size() < n_threads) {
+            shards_.resize(n_threads);
+        }
+        std::atomic<std::size_t> next_piece{0};
+        std::vector<std::thread> workers;
+        workers.reserve(n_threads);
+        for (std::size_t t = 0; t < n_threads; t++) {
+            workers.emplace_back([&, t]() {
+                PDF_ & target = shared ? pdf : shards_[t].pdf;
+                if (!shared) {
+                    target.clear();
+                }
+                std::size_t p;
+                while ((p = next_piece.fetch_add(1)) < pieces.size()) {
+                    sample_batch_(pieces[p], target, t, shared);
+                }
+            });
+        }
+        for (auto & w : workers) {
+            w.join();
+        }
+        if (shared) {
+            return;
+        }
+        std::uint64_t tick = sampler_stats_::start();
+        for (std::size_t t = 0; t < n_threads; t++) {
+            pdf += shards_[t].pdf;
+        }
+        sampler_stats_::lap(stats_run_.reduce_ticks, tick);
+    }
+
+    // ------------------------------------------------------------------------
+    // Sample a range of tuples lying within one chunk, with derivatives
+
+private:
+
+    // -- Same draws and hard deposits as sample_piece_.
+    // -- Each normalized value z is also spread over the two nearest bin
+    //    centers with a tent kernel, which is differentiable in z.
+    // -- A drawn value x = (1 - w) y_k + w y_{k+1} depends on the two knots
+    //    around its uniform, and z_m = x_m / sum depends on every x_i through
+    //    dz_m/dx_i = (delta_mi - z_m) / sum, so each deposit touches two bins
+    //    and at most 2 N_SUM knots.
+    template <typename Result>
+    void sample_piece_gradient_(std::size_t const first, std::size_t const last,
+            Result & result, std::vector<Float> & buffer) const {
+        constexpr std::size_t N_KNOTS = N_BINS - 1;
+        std::size_t start = group_start_(first);
+        auto engine = make_piece_engine_(start, last, buffer);
+        Float * x_block = buffer.data() + BLOCK_TUPLES_ * N_SUM;
+        for (std::size_t n = start; n < last; n += BLOCK_TUPLES_) {
+            std::size_t n_block = std::min(BLOCK_TUPLES_, last - n);
+            std::size_t skip = n < first ? first - n : 0;
+            Float const * y = draw_tuples_(engine, n, n_block, buffer);
+            inverse_cdfs_::evaluate(inverse_cdf_, y, x_block, n_block * N_SUM);
+            Float const * x = x_block + skip * N_SUM;
+            y += skip * N_SUM;
+            for (std::size_t t = skip; t < n_block; t++, x += N_SUM, y += N_SUM) {
+                auto values = generate_normalized_values_(x);
+                deposit_values_(values, result.pdf);
+
+                Float sum{0};
+                for (std::size_t i = 0; i < N_SUM; i++) {
+                    sum += clamp_random_number_(x[i]);
+                }
+                constexpr std::size_t N_DEPOSIT = deposit_all ? N_SUM : 1;
+                for (std::size_t m = 0; m < N_DEPOSIT; m++) {
+                    Float z;
+                    if constexpr (deposit_all) {
+                        z = values[m];
+                    } else {
+                        z = values;
+                    }
+                    // Tent kernel in bin-center coordinates
+                    Float s = z * Float(N_BINS) - Float{0.5};
+                    Float s_floor = std::floor(s);
+                    Float f = s - s_floor;
+                    long b = long(s_floor);
+                    std::size_t b_lo = std::size_t(std::max(b, 0L));
+                    std::size_t b_hi = std::size_t(std::min(b + 1, long(N_BINS) - 1));
+                    result.smoothed[b_lo] += Float{1} - f;
+                    result.smoothed[b_hi] += f;
+                    if (b_lo == b_hi) {
+                        continue;
+                    }
+                    Float * row_lo = result.jacobian.data() + b_lo * N_KNOTS;
+                    Float * row_hi = result.jacobian.data() + b_hi * N_KNOTS;
+                    for (std::size_t i = 0; i < N_SUM; i++) {
+                        // dz_m/dx_i, times d(weight)/dz = N_BINS
+                        Float dz = ((i == m ? Float{1} : Float{0}) - z) / sum
+                            * Float(N_BINS);
+                        Float u = y[i] * Float(N_BINS);
+                        std::size_t k = std::size_t(u);
+                        Float w = u - Float(k);
+                        // Knot j is the value at bin edge j + 1
+                        if (k >= 1) {
+                            row_lo[k-1] -= dz * (Float{1} - w);
+                            row_hi[k-1] += dz * (Float{1} - w);
+                        }
+                        if (k + 1 <= N_KNOTS) {
+                            row_lo[k] -= dz * w;
+                            row_hi[k] += dz * w;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Configure the sampling
+
+public:
+
+    // Replace the inverse CDF (e.g. between optimizer iterations), keeping
+    // the rest of the set-up.
+    void set_inverse_cdf(InverseCDF const & inverse_cdf) {
+        inverse_cdf_ = inverse_cdf;
+    }
+
+    // Fix the seed so that generate() is reproducible.
+    void set_seed(std::uint64_t const seed) {
+        seed_ = seed;
+        current_seed_ = seed;
+    }
+
+    // Select the RNG stream (zero if never set).  Runs with the same seed but
+    // different streams are independent.
+    void set_stream(std::uint64_t const stream) {
+        stream_ = stream;
+        current_stream_ = stream;
+    }
+
+    // Set the stopping rule (default: FixedCount(1000000)).
+    void set_stopping_rule(StoppingRule rule) {
+        stopping_rule_ = std::move(rule);
+    }
+
+    // Number of worker threads used by generate() (0 means one per core).
+    void set_threads(std::size_t const n_threads) {
+        n_threads_ = n_threads;
+    }
+
+    // Record the uniforms of the next run in the cache and replay them in
+    // every later run (common random numbers).  Once the cache holds a
+    // recording, its seed and stream replace the sampler's.  Pass nullptr to
+    // go back to fresh draws.
+    void set_uniform_cache(std::shared_ptr<Cache> cache) {
+        cache_ = std::move(cache);
+    }
+
+    // Draw the tuples with a variance-reduction mode (see SamplingModes.hpp;
+    // default: independent).  Results stay independent of the number of
+    // threads, and checkpoints record the mode.
+    void set_sampling_mode(SamplingMode const mode) {
+        mode_ = mode;
+    }
+
+    // Collect per-chunk batches in generate(), so that the PDF's
+    // get_bin_variance() measures the variance of each bin's count instead
+    // of assuming independent deposits (which overstates it for the
+    // variance-reduction modes).  Costs one pass over the bins per chunk.
+    void set_batch_variance(bool const on) {
+        batch_variance_ = on;
+    }
+
+    // Stream every normalized tuple drawn (all N_SUM values, also when only
+    // the first is deposited) to the exporter; pass nullptr to stop.
+    // -- Tuples are exported by generate() and sample_range() alike, so use a
+    //    fresh exporter per run; close it to finish the file.
+    // -- The PDF is the same with or without an exporter.
+    // -- Not across processes: do not fork (ShardRunner) with an exporter set.
+    // -- Any TupleSink will do (see SamplerHooks.hpp).
+    void set_exporter(std::shared_ptr<TupleSink<Float, N_SUM>> exporter) {
+        if (exporter && exporter->block_tuples() < BLOCK_TUPLES_) {
+            throw std::invalid_argument("ProbabilitySampler: exporter blocks "
+                    "must hold at least " + std::to_string(BLOCK_TUPLES_)
+                    + " tuples");
+        }
+        exporter_ = std::move(exporter);
+    }
+
+    // Write the output PDF of generate() to a checkpoint file (see
+    // PDFCheckpoint.hpp) every interval tuples and at the end, and resume
+    // from the file if it already exists.
+    // -- A resumed run takes its seed and stream from the file, and the file
+    //    must match this sampler (deposit mode, N_SUM, N_BINS, inverse CDF,
+    //    and the seed and stream if those are set).  A complete run's
+    //    checkpoint is simply returned again, so remove the file to start
+    //    afresh.
+    // -- Results are the same with or without checkpoints.
+    // -- An empty path turns checkpointing off.  Not for use with a uniform
+    //    cache.
+    // -- Needs PDFCheckpoint.hpp, or another Store (see SamplerHooks.hpp)
+    //    constructed from the path.
+    template <typename Store = CheckpointFile<PDF_>>
+    void set_checkpoint(std::string path, std::size_t const interval = 0) {
+        if (path.empty()) {
+            checkpoint_.reset();
+        } else {
+            checkpoint_ = std::make_shared<Store>(std::move(path));
+        }
+        checkpoint_interval_ = checkpoint_ ? interval : 0;
+    }
+
+    // ------------------------------------------------------------------------
+    // Checkpoints
+
+private:
+
+    // Fingerprint of the inverse CDF (FNV-1a over its values at a fixed set
+    // of points), to tell whether a checkpoint came from the same function
+    std::uint64_t inverse_cdf_hash_() const {
+        constexpr std::size_t N_POINTS = 4096;
+        std::uint64_t hash = 14695981039346656037ull;
+        for (std::size_t n = 0; n < N_POINTS; n++) {
+            Float y = inverse_cdf_((Float(n) + Float{0.5}) / Float(N_POINTS));
+            unsigned char bytes[sizeof(Float)];
+            std::memcpy(bytes, &y, sizeof(Float));
+            for (auto b : bytes) {
+                hash = (hash ^ b) * 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    CheckpointInfo run_info_(std::size_t const first,
+            std::size_t const last) const {
+        return {deposit_all, N_SUM, current_seed_, current_stream_,
+            inverse_cdf_hash_(), first, last, std::uint32_t(mode_)};
+    }
+
+    // Loads the checkpoint (if any) into pdf, takes over its seed and stream,
+    // and returns the number of tuples it covers.
+    std::size_t resume_(PDF_ & pdf) {
+        if (!checkpoint_ || !checkpoint_->exists()) {
+            return 0;
+        }
+        assert(!cache_);
+        CheckpointInfo info = checkpoint_->read(pdf);
+        if (info.deposit_all != deposit_all || info.n_sum != N_SUM
+                || info.inverse_cdf_hash != inverse_cdf_hash_()
+                || info.first_tuple != 0
+                || info.sampling_mode != std::uint32_t(mode_)
+                || (seed_ && info.seed != *seed_)
+                || (stream_ && info.stream != *stream_)) {
+            throw std::runtime_error("checkpoint: " + checkpoint_->name()
+                    + " is from a different run");
+        }
+        current_seed_ = info.seed;
+        current_stream_ = info.stream;
+        return info.last_tuple;
+    }
+
+public:
+
+    // Metadata for a checkpoint of the tuples [first, last) of the run with
+    // the fixed seed and stream (e.g. filled by sample_range in another
+    // process; see merge_checkpoints)
+    CheckpointInfo checkpoint_info(std::size_t const first,
+            std::size_t const last) const {
+        assert(seed_);
+        return run_info_(first, last);
+    }
+
     // ------------------------------------------------------------------------
     // Generate the output distribution from the input distribution
 
 public:
 
     auto generate() {
-        // Declare the PDF to be constructed
-        BinnedPDF<Float, int, N_BINS> pdf;
-        // Zero out PDF
-        // TODO -- Is this needed anymore?
+        PDF_ pdf;
+        generate(pdf);
+        return pdf;
+    }
+
+    // The same into pdf (cleared first), which the caller may keep on the
+    // heap: at 2^20 bins and more a PDF is too big for the stack.
+    void generate(PDF_ & pdf) {
         pdf.clear();
+        stats_begin_();
         // Set up random number generator
         set_up_rng_();
-        // Sampling loop
-        while (continue_condition_(pdf)) {
-            // TODO: parallelize?
-            auto values = generate_normalized_values_();
-            deposit_values_(std::move(values), pdf);
+        // Pick up where a checkpointed run left off
+        std::uint64_t tick = sampler_stats_::start();
+        std::size_t n_tuples = resume_(pdf);
+        sampler_stats_::lap(stats_run_.checkpoint_ticks, tick);
+        // Sampling loop, one round per consultation of the stopping rule
+        // (cut at each checkpoint, which does not change the result)
+        while (true) {
+            tick = sampler_stats_::start();
+            std::size_t n_deposits = stopping_rule_(pdf);
+            stats_round_(n_tuples, n_deposits, tick);
+            if (n_deposits == 0) {
+                break;
+            }
+            std::size_t end = n_tuples + tuples_for(n_deposits);
+            while (n_tuples < end) {
+                std::size_t stop = end;
+                if (checkpoint_interval_ > 0) {
+                    stop = std::min(end, (n_tuples / checkpoint_interval_ + 1)
+                            * checkpoint_interval_);
+                }
+                sample_tuples_(n_tuples, stop, pdf);
+                n_tuples = stop;
+                update_cache_(n_tuples);
+                if (checkpoint_interval_ > 0
+                        && n_tuples % checkpoint_interval_ == 0) {
+                    tick = sampler_stats_::start();
+                    checkpoint_->write(pdf, run_info_(0, n_tuples));
+                    sampler_stats_::lap(stats_run_.checkpoint_ticks, tick);
+                }
+            }
         }
-        // Return result
-        return pdf;
+        if (checkpoint_) {
+            tick = sampler_stats_::start();
+            checkpoint_->write(pdf, run_info_(0, n_tuples));
+            sampler_stats_::lap(stats_run_.checkpoint_ticks, tick);
+        }
+        stats_end_();
+    }
+
+    // Statistics of the last generate() (see SamplerStats.hpp; all zero
+    // unless compiled with SAMPLER_STATS)
+    SamplerStats const & stats() const {
+        return stats_;
+    }
+
+    // ------------------------------------------------------------------------
+    // Run statistics
+
+private:
+
+    // Bookkeeping of the statistics during generate()
+    struct StatsRun_ {
+        std::vector<ThreadCounters> threads;
+        std::uint64_t start_ticks{0};
+        std::chrono::steady_clock::time_point start;
+        std::uint64_t reduce_ticks{0};
+        std::uint64_t stopping_rule_ticks{0};
+        std::uint64_t checkpoint_ticks{0};
+        // Tuples, requested deposits and ticks at each stopping rule call
+        std::vector<std::array<std::uint64_t, 3>> rounds;
+    };
+
+    ThreadCounters * counters_(std::size_t const t) {
+        if constexpr (sampler_stats_::ENABLED) {
+            return &stats_run_.threads[t];
+        }
+        return nullptr;
+    }
+
+    void stats_begin_() {
+        if constexpr (sampler_stats_::ENABLED) {
+            stats_run_ = StatsRun_();
+            stats_run_.start = std::chrono::steady_clock::now();
+            stats_run_.start_ticks = sampler_stats_::ticks();
+        }
+    }
+
+    void stats_round_(std::size_t const n_tuples, std::size_t const n_deposits,
+            std::uint64_t tick) {
+        if constexpr (sampler_stats_::ENABLED) {
+            stats_run_.rounds.push_back({n_tuples, n_deposits, tick});
+            sampler_stats_::lap(stats_run_.stopping_rule_ticks, tick);
+        }
+    }
+
+    void stats_end_() {
+        if constexpr (!sampler_stats_::ENABLED) {
+            return;
+        }
+        auto & run = stats_run_;
+        SamplerStats stats;
+        stats.seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - run.start).count();
+        std::uint64_t ticks = sampler_stats_::ticks() - run.start_ticks;
+        stats.ticks_per_second = stats.seconds > 0
+            ? double(ticks) / stats.seconds : 0;
+        auto seconds = [&](std::uint64_t const t) {
+            return stats.ticks_per_second > 0
+                ? double(t) / stats.ticks_per_second : 0;
+        };
+        for (auto const & c : run.threads) {
+            stats.tuples += c.tuples;
+            stats.zero_draws += c.zero_draws;
+            stats.unit_values += c.unit_values;
+            stats.draw_seconds += seconds(c.draw_ticks);
+            stats.inverse_cdf_seconds += seconds(c.inverse_cdf_ticks);
+            stats.normalize_seconds += seconds(c.normalize_ticks);
+            stats.deposit_seconds += seconds(c.deposit_ticks);
+            double busy = seconds(c.draw_ticks + c.inverse_cdf_ticks
+                    + c.normalize_ticks + c.deposit_ticks);
+            stats.threads.push_back({c.tuples, busy,
+                    busy > 0 ? double(c.tuples) / busy : 0});
+        }
+        stats.deposits = stats.tuples * PER_TUPLE_;
+        stats.reduce_seconds = seconds(run.reduce_ticks);
+        stats.stopping_rule_seconds = seconds(run.stopping_rule_ticks);
+        stats.checkpoint_seconds = seconds(run.checkpoint_ticks);
+        for (auto const & r : run.rounds) {
+            stats.rounds.push_back({r[0], r[1], seconds(r[2] - run.start_ticks)});
+        }
+        stats_ = std::move(stats);
+    }
+
+    // ------------------------------------------------------------------------
+    // Sample part of a run
+
+public:
+
+    // Tuples per chunk: ranges starting and ending on multiples of this share
+    // no chunk.
+    static constexpr std::size_t chunk_tuples() {
+        return CHUNK_TUPLES_;
+    }
+
+    // Tuples needed for a number of deposits
+    static constexpr std::size_t tuples_for(std::size_t const n_deposits) {
+        return (n_deposits + PER_TUPLE_ - 1) / PER_TUPLE_;
+    }
+
+    // Add the tuples [first, last) of the run with the fixed seed and stream
+    // to pdf, on the calling thread with the caller's work space.  The sampler
+    // is not modified, so several threads can fill different ranges of one
+    // run at once.  Summed over [0, tuples_for(n)), the ranges give the bins
+    // generate() gives for FixedCount(n).  (No uniform cache.)
+    // -- pdf may also be a DynamicBinnedPDF resized to N_BINS, which gets the
+    //    same bins without a fixed-size copy.
+    template <typename Histogram>
+    void sample_range(std::size_t const first, std::size_t const last,
+            Histogram & pdf, std::vector<Float> & buffer) const {
+        assert(seed_);
+        assert(!cache_);
+        for (auto const & piece : split_pieces_(first, last)) {
+            sample_piece_(piece[0], piece[1], pdf, buffer);
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Generate independent replicates of the output distribution for error
+    // bars
+
+public:
+
+    struct ReplicateResult {
+        // All replicates merged
+        PDF_ pdf;
+        // Mean over replicates of the normalized PDF
+        std::array<Float, N_BINS> mean;
+        // Standard error of that mean
+        std::array<Float, N_BINS> std_error;
+    };
+
+    // Replicate r uses stream stream_ + r.  With a scrambled quasi-random RNG
+    // (SobolRNG) each replicate is a different randomization of the same
+    // point set, so this is randomized QMC.  (With a uniform cache every
+    // replicate is the same run.)
+    auto generate_replicates(std::size_t const n_replicates) {
+        assert(n_replicates >= 2);
+        ReplicateResult result;
+        std::array<double, N_BINS> sum{};
+        std::array<double, N_BINS> sum_sq{};
+        std::optional<std::uint64_t> const saved = stream_;
+        std::uint64_t base = stream_.value_or(0);
+        for (std::size_t r = 0; r < n_replicates; r++) {
+            stream_ = base + r;
+            auto pdf = generate();
+            auto p = pdf.get_pdf();
+            for (std::size_t n = 0; n < N_BINS; n++) {
+                sum[n] += p[n];
+                sum_sq[n] += double(p[n]) * double(p[n]);
+            }
+            result.pdf += pdf;
+        }
+        stream_ = saved;
+        double R = double(n_replicates);
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            double mean = sum[n] / R;
+            double var = std::max(0.0, (sum_sq[n] - R * mean * mean) / (R - 1));
+            result.mean[n] = Float(mean);
+            result.std_error[n] = Float(std::sqrt(var / R));
+        }
+        return result;
+    }
+
+    // ------------------------------------------------------------------------
+    // Generate the output distribution and its derivatives with respect to
+    // the knots of the inverse CDF in a single pass
+
+public:
+
+    struct GradientResult {
+        // The same histogram generate() would give
+        PDF_ pdf;
+        // Tent-kernel smoothed output PDF (sums to one)
+        std::array<Float, N_BINS> smoothed;
+        // d smoothed[b] / d knot[k] at [b * (N_BINS-1) + k], where knot[k] is
+        // the inverse CDF at the bin edge (k+1) / N_BINS
+        std::vector<Float> jacobian;
+        // Uniformity loss: mean over bins of (N_BINS smoothed[b] - 1)^2
+        Float loss;
+        // d loss / d knot[k]
+        std::array<Float, N_BINS-1> gradient;
+    };
+
+    // Runs serially (set_threads() is ignored).
+    auto generate_with_gradient() {
+        static_assert(std::is_same_v<InverseCDF,
+                PiecewiseLinearFunction<Float, N_BINS>>,
+                "gradients are with respect to the knots of a tabulated "
+                "inverse CDF");
+        constexpr std::size_t N_KNOTS = N_BINS - 1;
+        GradientResult result;
+        result.smoothed.fill(Float{0});
+        result.jacobian.assign(N_BINS * N_KNOTS, Float{0});
+        if (buffers_.empty()) {
+            buffers_.resize(1);
+        }
+        set_up_rng_();
+        std::size_t n_tuples = 0;
+        std::size_t n_deposits;
+        while ((n_deposits = stopping_rule_(result.pdf)) > 0) {
+            std::size_t n_new = (n_deposits + PER_TUPLE_ - 1) / PER_TUPLE_;
+            for (auto const & piece : split_pieces_(n_tuples, n_tuples + n_new)) {
+                sample_piece_gradient_(piece[0], piece[1], result, buffers_[0]);
+            }
+            n_tuples += n_new;
+            update_cache_(n_tuples);
+        }
+        // Normalize and form the loss and its gradient
+        Float denom = Float{1} / Float(result.pdf.count());
+        for (auto & p : result.smoothed) {
+            p *= denom;
+        }
+        for (auto & d : result.jacobian) {
+            d *= denom;
+        }
+        result.loss = Float{0};
+        result.gradient.fill(Float{0});
+        for (std::size_t b = 0; b < N_BINS; b++) {
+            Float e = Float(N_BINS) * result.smoothed[b] - Float{1};
+            result.loss += e * e;
+            Float scale = Float{2} * e;
+            Float const * row = result.jacobian.data() + b * N_KNOTS;
+            for (std::size_t k = 0; k < N_KNOTS; k++) {
+                result.gradient[k] += scale * row[k];
+            }
+        }
+        result.loss /= Float(N_BINS);
+        return result;
     }
 
     // ------------------------------------------------------------------------
@@ -193,11 +1128,44 @@ public:
 private:
 
     // Inverse CDF of input distribution
-    PiecewiseLinearFunction<Float, N_BINS> inverse_cdf_;
+    InverseCDF inverse_cdf_;
 
     // Random number generator data
-    decltype(get_rng_engine_<Float>()) engine_;
-    std::uniform_real_distribution<Float> uniform_;
+    std::optional<std::uint64_t> seed_;
+    std::uint64_t current_seed_{0};
+    std::optional<std::uint64_t> stream_;
+    std::uint64_t current_stream_{0};
+
+    // Stored uniforms (optional)
+    std::shared_ptr<Cache> cache_;
+
+    // Number of worker threads
+    std::size_t n_threads_{1};
+
+    // How long to keep sampling
+    StoppingRule stopping_rule_{FixedCount(1000000)};
+
+    // Checkpoint store and interval in tuples (zero: only at the end)
+    std::shared_ptr<CheckpointStore<PDF_>> checkpoint_;
+    std::size_t checkpoint_interval_{0};
+
+    // Where the normalized tuples go (optional)
+    std::shared_ptr<TupleSink<Float, N_SUM>> exporter_;
+
+    // Run statistics (only collected with SAMPLER_STATS)
+    StatsRun_ stats_run_;
+    SamplerStats stats_;
+
+    // How the uniforms of the tuples are drawn (see SamplingModes.hpp)
+    SamplingMode mode_{SamplingMode::independent};
+
+    // Whether generate() collects batches for a variance estimate
+    bool batch_variance_{false};
+
+    // Work space, kept between calls to generate()
+    std::vector<std::vector<Float>> buffers_;
+    std::vector<Shard_> shards_;
+    std::vector<Shard_> batches_;
 
     // ------------------------------------------------------------------------
     // Notes
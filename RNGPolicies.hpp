@@ -0,0 +1,251 @@
+#ifndef RNG_POLICIES_HPP
+#define RNG_POLICIES_HPP
+
+// RNG policies for ProbabilitySampler.
+//
+// A policy provides:
+// -- engine_type : the engine holding the RNG state
+// -- seekable    : whether the policy provides skip()
+// -- make_engine(seed, stream) : an engine for one independent stream
+// -- uniform(engine) : a value in [0,1)
+// -- skip(engine, n) : (seekable policies only) skip n uniforms in O(1)
+// -- fill(engine, out, n) : (optional) n uniforms at once, identical to n
+//                           calls to uniform()
+// -- dimension : (optional) the tuple size the policy is built for, for
+//                quasi-random sequences whose consecutive draws are the
+//                coordinates of one point
+//
+// Seekable policies let the sampler treat a whole run as one sequence and jump
+// straight to the start of each chunk.  Other policies get one stream per
+// chunk instead.
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <utility>
+
+// ============================================================================
+// Mersenne Twister (the original generator)
+
+template <typename Float>
+struct MersenneTwisterRNG {
+
+    using engine_type = typename std::conditional<
+        std::is_same<Float, float>::value,
+        std::mt19937, std::mt19937_64>::type;
+
+    static constexpr bool seekable = false;
+
+    static engine_type make_engine(
+            std::uint64_t const seed, std::uint64_t const stream) {
+        std::seed_seq seq{
+            std::uint32_t(seed), std::uint32_t(seed >> 32),
+            std::uint32_t(stream), std::uint32_t(stream >> 32)};
+        return engine_type(seq);
+    }
+
+    static Float uniform(engine_type & engine) {
+        std::uniform_real_distribution<Float> dist(Float{0}, Float{1});
+        return dist(engine);
+    }
+
+};
+
+// ============================================================================
+// Philox4x32-10 counter-based engine
+// -- Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (SC11).
+// -- The 128-bit counter is (block index, stream) and the 64-bit key is the
+//    seed, so every output word is a pure function of (seed, stream, index).
+//    The state is a few words and discard() is O(1).
+
+class Philox4x32 {
+
+    // ------------------------------------------------------------------------
+    // Constants
+
+private:
+
+    static constexpr std::uint32_t M0_ = 0xD2511F53;
+    static constexpr std::uint32_t M1_ = 0xCD9E8D57;
+    static constexpr std::uint32_t W0_ = 0x9E3779B9;
+    static constexpr std::uint32_t W1_ = 0xBB67AE85;
+
+    static constexpr int N_ROUNDS_ = 10;
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    std::uint64_t key_;
+    std::uint64_t stream_;
+
+    // Index of the next output word
+    std::uint64_t position_;
+
+    // Most recently computed block and its index
+    std::array<std::uint32_t, 4> block_;
+    std::uint64_t block_index_;
+
+    // ------------------------------------------------------------------------
+    // Bijection
+
+public:
+
+    using Block = std::array<std::uint32_t, 4>;
+
+    static Block bijection(Block ctr, std::array<std::uint32_t, 2> key) {
+        for (int r = 0; r < N_ROUNDS_; r++) {
+            if (r > 0) {
+                key[0] += W0_;
+                key[1] += W1_;
+            }
+            std::uint64_t p0 = std::uint64_t(M0_) * ctr[0];
+            std::uint64_t p1 = std::uint64_t(M1_) * ctr[2];
+            ctr = Block{
+                std::uint32_t(p1 >> 32) ^ ctr[1] ^ key[0],
+                std::uint32_t(p1),
+                std::uint32_t(p0 >> 32) ^ ctr[3] ^ key[1],
+                std::uint32_t(p0)};
+        }
+        return ctr;
+    }
+
+private:
+
+    void compute_block_(std::uint64_t const index) {
+        Block ctr{
+            std::uint32_t(index), std::uint32_t(index >> 32),
+            std::uint32_t(stream_), std::uint32_t(stream_ >> 32)};
+        block_ = bijection(ctr, {std::uint32_t(key_), std::uint32_t(key_ >> 32)});
+        block_index_ = index;
+    }
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    using result_type = std::uint32_t;
+
+    Philox4x32(std::uint64_t const key = 0, std::uint64_t const stream = 0)
+        : key_(key)
+        , stream_(stream)
+        , position_(0)
+    {
+        compute_block_(0);
+    }
+
+    // ------------------------------------------------------------------------
+    // UniformRandomBitGenerator interface
+
+public:
+
+    static constexpr result_type min() {
+        return 0;
+    }
+
+    static constexpr result_type max() {
+        return std::numeric_limits<result_type>::max();
+    }
+
+    result_type operator()() {
+        std::uint64_t index = position_ >> 2;
+        if (index != block_index_) {
+            compute_block_(index);
+        }
+        return block_[position_++ & 3];
+    }
+
+    // ------------------------------------------------------------------------
+    // Seeking
+
+public:
+
+    // Skip n output words.
+    void discard(unsigned long long const n) {
+        position_ += n;
+    }
+
+    // Index of the next output word within the stream.
+    std::uint64_t position() const {
+        return position_;
+    }
+
+};
+
+// ============================================================================
+// Philox policy
+
+template <typename Float>
+struct PhiloxRNG {
+
+    using engine_type = Philox4x32;
+
+    static constexpr bool seekable = true;
+
+    static engine_type make_engine(
+            std::uint64_t const seed, std::uint64_t const stream) {
+        return engine_type(seed, stream);
+    }
+
+    static void skip(engine_type & engine, std::uint64_t const n) {
+        constexpr std::uint64_t WORDS = std::is_same<Float, float>::value ? 1 : 2;
+        engine.discard(n * WORDS);
+    }
+
+    // Uses 24 (float) or 53 (double) random bits, so the result is exactly
+    // representable and strictly less than one.
+    static Float uniform(engine_type & engine) {
+        if constexpr (std::is_same<Float, float>::value) {
+            return float(engine() >> 8) * 0x1p-24f;
+        } else {
+            std::uint64_t hi = engine();
+            std::uint64_t lo = engine();
+            return double(((hi << 32) | lo) >> 11) * 0x1p-53;
+        }
+    }
+
+};
+
+// ============================================================================
+// Block generation
+
+namespace {
+
+template <typename RNG, typename = void>
+struct has_fill_ : std::false_type {};
+
+template <typename RNG>
+struct has_fill_<RNG, std::void_t<decltype(RNG::fill(
+        std::declval<typename RNG::engine_type &>(),
+        std::declval<decltype(RNG::uniform(
+            std::declval<typename RNG::engine_type &>())) *>(),
+        std::size_t{}))>> : std::true_type {};
+
+template <typename RNG, typename = void>
+struct rng_dimension_ : std::integral_constant<std::size_t, 0> {};
+
+template <typename RNG>
+struct rng_dimension_<RNG, std::void_t<decltype(RNG::dimension)>>
+    : std::integral_constant<std::size_t, RNG::dimension> {};
+
+} // end namespace
+
+// Fill out[0..n) with uniforms, using the policy's block path if it has one.
+template <typename RNG, typename Float>
+void fill_uniforms(typename RNG::engine_type & engine, Float * out,
+        std::size_t const n) {
+    if constexpr (has_fill_<RNG>::value) {
+        RNG::fill(engine, out, n);
+    } else {
+        for (std::size_t i = 0; i < n; i++) {
+            out[i] = RNG::uniform(engine);
+        }
+    }
+}
+
+#endif // RNG_POLICIES_HPP
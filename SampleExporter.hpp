@@ -0,0 +1,519 @@
+#ifndef SAMPLE_EXPORTER_HPP
+#define SAMPLE_EXPORTER_HPP
+
+// Streams the normalized tuples a sampler draws to a binary file.
+//
+// The sampler's worker threads fill fixed-size blocks of tuples and hand them
+// over through a lock-free ring; one writer thread streams the blocks to the
+// file with large gathered writes, so sampling only stalls if the disk cannot
+// keep up with it.
+// -- Blocks cycle between two bounded lock-free MPMC queues (Vyukov's
+//    sequence-numbered ring): free blocks for the workers to fill and full
+//    blocks for the writer.  No allocation happens after construction.
+// -- The writer takes up to WRITE_BLOCKS_ full blocks at a time and writes
+//    them with one writev(), straight from the blocks.
+// -- Compile with SAMPLE_EXPORTER_ZLIB defined to 1 (and link -lz) to allow
+//    gzip-compressed output; the stream inside is the same.  Only Huffman
+//    coding is used: the random mantissas do not compress anyway, and full
+//    deflate is several times slower for about the same size.
+//
+// File format (native byte order):
+// -- header : magic "NRDTUPL\0", version (uint32), N_SUM (uint32), bytes per
+//             value (uint32), zero (uint32), 8 bytes of padding
+// -- records: first tuple index (uint64), number of tuples n (uint64), then
+//             n tuples of N_SUM values
+// Records from different worker threads arrive in any order; the tuple
+// indices put them back in order (read_all does).
+
+#include "SamplerHooks.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef SAMPLE_EXPORTER_ZLIB
+#define SAMPLE_EXPORTER_ZLIB 0
+#endif
+
+#if SAMPLE_EXPORTER_ZLIB
+#include <zlib.h>
+#endif
+
+// ============================================================================
+// Bounded lock-free queue of indices (D. Vyukov's MPMC ring)
+
+namespace sample_exporter_ {
+
+class IndexRing {
+
+public:
+
+    // Capacity must be a power of two.
+    explicit IndexRing(std::size_t const capacity)
+        : cells_(capacity)
+        , mask_(capacity - 1)
+    {
+        assert((capacity & mask_) == 0);
+        for (std::size_t i = 0; i < capacity; i++) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(std::uint32_t const value) {
+        std::size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell_ & cell = cells_[pos & mask_];
+            std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = std::intptr_t(seq) - std::intptr_t(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1,
+                            std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool pop(std::uint32_t & value) {
+        std::size_t pos = head_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell_ & cell = cells_[pos & mask_];
+            std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            auto diff = std::intptr_t(seq) - std::intptr_t(pos + 1);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1,
+                            std::memory_order_relaxed)) {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask_ + 1,
+                            std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+
+    struct Cell_ {
+        std::atomic<std::size_t> sequence;
+        std::uint32_t value;
+    };
+
+    std::vector<Cell_> cells_;
+    std::size_t mask_;
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    alignas(64) std::atomic<std::size_t> head_{0};
+
+};
+
+// Back off while waiting on the other side of a ring: yield first (on a
+// machine with few cores the other side needs the CPU), then sleep.
+inline void back_off(std::size_t & spins) {
+    if (++spins < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+constexpr char MAGIC[8] = {'N', 'R', 'D', 'T', 'U', 'P', 'L', '\0'};
+constexpr std::uint32_t VERSION = 1;
+constexpr std::size_t HEADER_BYTES = 32;
+constexpr std::size_t RECORD_HEADER_BYTES = 16;
+
+} // end namespace sample_exporter_
+
+// ============================================================================
+
+template <typename Float, std::size_t N_SUM>
+class SampleExporter : public TupleSink<Float, N_SUM> {
+
+    // ------------------------------------------------------------------------
+    // Types
+
+public:
+
+    // A block being filled by a worker thread
+    using Block = typename TupleSink<Float, N_SUM>::Block;
+
+private:
+
+    // Blocks taken by the writer per write
+    static constexpr std::size_t WRITE_BLOCKS_ = 32;
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Streams to path (gzip-compressed if compress, which needs
+    // SAMPLE_EXPORTER_ZLIB) in blocks of block_tuples tuples, with n_blocks
+    // blocks in flight (a power of two, at least 2 WRITE_BLOCKS_).
+    explicit SampleExporter(std::string const & path,
+            bool const compress = false,
+            std::size_t const block_tuples = std::size_t(1) << 10,
+            std::size_t const n_blocks = 128)
+        : block_tuples_(block_tuples)
+        , block_bytes_(sample_exporter_::RECORD_HEADER_BYTES
+                + block_tuples * N_SUM * sizeof(Float))
+        , n_blocks_(n_blocks)
+        , memory_(n_blocks * block_bytes_ / sizeof(std::uint64_t) + 1)
+        , free_(n_blocks)
+        , full_(n_blocks)
+    {
+        static_assert(sample_exporter_::RECORD_HEADER_BYTES % sizeof(Float) == 0,
+                "record header must keep the values aligned");
+        assert(n_blocks >= 2 * WRITE_BLOCKS_);
+        for (std::size_t b = 0; b < n_blocks; b++) {
+            free_.push(std::uint32_t(b));
+        }
+        open_(path, compress);
+        writer_ = std::thread([this]() { write_loop_(); });
+    }
+
+    SampleExporter(SampleExporter const &) = delete;
+    SampleExporter & operator=(SampleExporter const &) = delete;
+
+    // Writes out and closes like close(), but drops a write error: call
+    // close() first to see it.
+    ~SampleExporter() {
+        finish_();
+    }
+
+    // ------------------------------------------------------------------------
+    // Export
+
+public:
+
+    std::size_t block_tuples() const override {
+        return block_tuples_;
+    }
+
+    // A free block to fill (waits for the writer if none is free)
+    Block acquire() override {
+        std::uint32_t b;
+        std::size_t spins = 0;
+        while (!free_.pop(b)) {
+            sample_exporter_::back_off(spins);
+        }
+        return {b, reinterpret_cast<Float *>(record_(b)
+                + sample_exporter_::RECORD_HEADER_BYTES), block_tuples_};
+    }
+
+    // Hands a block holding the tuples [first_tuple, first_tuple + n) to the
+    // writer.
+    void submit(Block const & block, std::uint64_t const first_tuple,
+            std::uint64_t const n) override {
+        assert(n <= block_tuples_);
+        char * record = record_(block.index);
+        std::memcpy(record, &first_tuple, sizeof(first_tuple));
+        std::memcpy(record + sizeof(first_tuple), &n, sizeof(n));
+        std::size_t spins = 0;
+        while (!full_.push(block.index)) {
+            sample_exporter_::back_off(spins);
+        }
+    }
+
+    // Writes out everything submitted so far and closes the file (also done
+    // by the destructor).  Throws std::system_error if a write failed.
+    void close() {
+        finish_();
+        if (error_ != 0) {
+            int err = error_;
+            error_ = 0;
+            throw std::system_error(err, std::generic_category(),
+                    "SampleExporter: write");
+        }
+    }
+
+    // Bytes written so far (before compression)
+    std::uint64_t bytes_written() const {
+        return bytes_written_.load(std::memory_order_relaxed);
+    }
+
+    // ------------------------------------------------------------------------
+    // Read back (for offline checks of small files)
+
+public:
+
+    // All tuples of an export (compressed ones need SAMPLE_EXPORTER_ZLIB), in
+    // tuple order, N_SUM values per tuple; throws std::runtime_error if the
+    // file is not a complete export of consecutive tuples.
+    static std::vector<Float> read_all(std::string const & path) {
+        std::vector<char> bytes = read_file_(path);
+        std::size_t pos = sample_exporter_::HEADER_BYTES;
+        if (bytes.size() < pos || std::memcmp(bytes.data(),
+                    sample_exporter_::MAGIC, 8) != 0) {
+            throw std::runtime_error("SampleExporter: " + path
+                    + " is not an export");
+        }
+        std::uint32_t n_sum;
+        std::uint32_t value_bytes;
+        std::memcpy(&n_sum, bytes.data() + 12, 4);
+        std::memcpy(&value_bytes, bytes.data() + 16, 4);
+        if (n_sum != N_SUM || value_bytes != sizeof(Float)) {
+            throw std::runtime_error("SampleExporter: " + path
+                    + " holds other tuples");
+        }
+        std::vector<std::pair<std::uint64_t, std::size_t>> records;
+        std::uint64_t n_tuples = 0;
+        while (pos + sample_exporter_::RECORD_HEADER_BYTES <= bytes.size()) {
+            std::uint64_t first;
+            std::uint64_t n;
+            std::memcpy(&first, bytes.data() + pos, 8);
+            std::memcpy(&n, bytes.data() + pos + 8, 8);
+            records.emplace_back(first, pos);
+            n_tuples += n;
+            pos += sample_exporter_::RECORD_HEADER_BYTES
+                + n * N_SUM * sizeof(Float);
+        }
+        if (pos != bytes.size()) {
+            throw std::runtime_error("SampleExporter: " + path
+                    + " is truncated");
+        }
+        std::sort(records.begin(), records.end());
+        std::vector<Float> tuples(n_tuples * N_SUM);
+        std::uint64_t next = records.empty() ? 0 : records.front().first;
+        std::size_t out = 0;
+        for (auto const & record : records) {
+            std::uint64_t n;
+            std::memcpy(&n, bytes.data() + record.second + 8, 8);
+            if (record.first != next) {
+                throw std::runtime_error("SampleExporter: " + path
+                        + " has a gap or overlap at tuple "
+                        + std::to_string(next));
+            }
+            std::memcpy(tuples.data() + out, bytes.data() + record.second
+                    + sample_exporter_::RECORD_HEADER_BYTES,
+                    n * N_SUM * sizeof(Float));
+            out += n * N_SUM;
+            next += n;
+        }
+        return tuples;
+    }
+
+    // ------------------------------------------------------------------------
+    // Writer
+
+private:
+
+    char * record_(std::uint32_t const b) {
+        return reinterpret_cast<char *>(memory_.data()) + b * block_bytes_;
+    }
+
+    static std::size_t record_bytes_(char const * record) {
+        std::uint64_t n;
+        std::memcpy(&n, record + sizeof(std::uint64_t), sizeof(n));
+        return sample_exporter_::RECORD_HEADER_BYTES + n * N_SUM * sizeof(Float);
+    }
+
+    void open_(std::string const & path, bool const compress) {
+        char header[sample_exporter_::HEADER_BYTES] = {};
+        std::uint32_t fields[4] = {sample_exporter_::VERSION,
+            std::uint32_t(N_SUM), std::uint32_t(sizeof(Float)), 0};
+        std::memcpy(header, sample_exporter_::MAGIC, 8);
+        std::memcpy(header + 8, fields, sizeof(fields));
+        if (compress) {
+#if SAMPLE_EXPORTER_ZLIB
+            gz_ = ::gzopen(path.c_str(), "wb1h");
+            if (gz_ == nullptr) {
+                throw std::system_error(errno, std::generic_category(),
+                        "SampleExporter: open " + path);
+            }
+            ::gzbuffer(gz_, 1 << 20);
+#else
+            throw std::runtime_error("SampleExporter: compression needs "
+                    "SAMPLE_EXPORTER_ZLIB");
+#endif
+        } else {
+            fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd_ < 0) {
+                throw std::system_error(errno, std::generic_category(),
+                        "SampleExporter: open " + path);
+            }
+        }
+        struct iovec header_io{header, sizeof(header)};
+        write_(&header_io, 1);
+    }
+
+    // Writes the buffers, recording the first error
+    void write_(struct iovec * io, int n_io) {
+        for (int i = 0; i < n_io; i++) {
+            bytes_written_.fetch_add(io[i].iov_len, std::memory_order_relaxed);
+        }
+#if SAMPLE_EXPORTER_ZLIB
+        if (gz_ != nullptr) {
+            for (int i = 0; i < n_io; i++) {
+                if (::gzwrite(gz_, io[i].iov_base, unsigned(io[i].iov_len))
+                        != int(io[i].iov_len) && error_ == 0) {
+                    error_ = EIO;
+                }
+            }
+            return;
+        }
+#endif
+        while (n_io > 0 && error_ == 0) {
+            ssize_t n = ::writev(fd_, io, n_io);
+            if (n < 0) {
+                if (errno != EINTR) {
+                    error_ = errno;
+                }
+                continue;
+            }
+            // Skip what was written (writev may stop partway)
+            std::size_t done = std::size_t(n);
+            while (n_io > 0 && done >= io->iov_len) {
+                done -= io->iov_len;
+                io++;
+                n_io--;
+            }
+            if (n_io > 0) {
+                io->iov_base = static_cast<char *>(io->iov_base) + done;
+                io->iov_len -= done;
+            }
+        }
+    }
+
+    void write_loop_() {
+        std::uint32_t taken[WRITE_BLOCKS_];
+        struct iovec io[WRITE_BLOCKS_];
+        while (true) {
+            // Check for stopping before draining, so nothing submitted
+            // before close() is left behind
+            bool stopping = stopping_.load(std::memory_order_acquire);
+            std::size_t n = 0;
+            while (n < WRITE_BLOCKS_ && full_.pop(taken[n])) {
+                char * record = record_(taken[n]);
+                io[n].iov_base = record;
+                io[n].iov_len = record_bytes_(record);
+                n++;
+            }
+            if (n == 0) {
+                if (stopping) {
+                    return;
+                }
+                // Let a batch build up rather than wake for every block
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            write_(io, int(n));
+            for (std::size_t i = 0; i < n; i++) {
+                free_.push(taken[i]);
+            }
+        }
+    }
+
+    // Stops the writer once it has written everything and closes the file;
+    // never throws (a failure is left in error_).
+    void finish_() noexcept {
+        if (!writer_.joinable()) {
+            return;
+        }
+        stopping_.store(true, std::memory_order_release);
+        writer_.join();
+        close_file_();
+    }
+
+    void close_file_() {
+#if SAMPLE_EXPORTER_ZLIB
+        if (gz_ != nullptr) {
+            if (::gzclose(gz_) != Z_OK && error_ == 0) {
+                error_ = EIO;
+            }
+            gz_ = nullptr;
+        }
+#endif
+        if (fd_ >= 0) {
+            if (::close(fd_) != 0 && error_ == 0) {
+                error_ = errno;
+            }
+            fd_ = -1;
+        }
+    }
+
+    static std::vector<char> read_file_(std::string const & path) {
+        std::vector<char> bytes;
+        char buffer[1 << 16];
+#if SAMPLE_EXPORTER_ZLIB
+        // gzread passes uncompressed files through unchanged
+        gzFile gz = ::gzopen(path.c_str(), "rb");
+        if (gz == nullptr) {
+            throw std::system_error(errno, std::generic_category(),
+                    "SampleExporter: open " + path);
+        }
+        int n;
+        while ((n = ::gzread(gz, buffer, sizeof(buffer))) > 0) {
+            bytes.insert(bytes.end(), buffer, buffer + n);
+        }
+        ::gzclose(gz);
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                    "SampleExporter: open " + path);
+        }
+        ssize_t n;
+        while ((n = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            bytes.insert(bytes.end(), buffer, buffer + n);
+        }
+        ::close(fd);
+#endif
+        return bytes;
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    std::size_t block_tuples_;
+    std::size_t block_bytes_;
+    std::size_t n_blocks_;
+
+    // The blocks, each a record header followed by its tuples (uint64 for
+    // alignment)
+    std::vector<std::uint64_t> memory_;
+
+    sample_exporter_::IndexRing free_;
+    sample_exporter_::IndexRing full_;
+
+    // Output
+    int fd_{-1};
+#if SAMPLE_EXPORTER_ZLIB
+    gzFile gz_{nullptr};
+#endif
+    int error_{0};
+    std::atomic<std::uint64_t> bytes_written_{0};
+
+    std::atomic<bool> stopping_{false};
+    std::thread writer_;
+
+};
+
+#endif // SAMPLE_EXPORTER_HPP
@@ -0,0 +1,96 @@
+#ifndef SAMPLER_HOOKS_HPP
+#define SAMPLER_HOOKS_HPP
+
+// The interfaces through which a ProbabilitySampler checkpoints its output
+// PDF and exports its tuples.
+//
+// The implementations (CheckpointFile in PDFCheckpoint.hpp, SampleExporter in
+// SampleExporter.hpp) need POSIX file I/O.  The sampler only includes this
+// header, so only the code that sets a checkpoint or an exporter has to
+// include them.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ============================================================================
+// Checkpoints
+
+// What a checkpoint covers
+struct CheckpointInfo {
+    bool deposit_all;
+    std::size_t n_sum;
+    std::uint64_t seed;
+    std::uint64_t stream;
+    // Fingerprint of the inverse CDF (see ProbabilitySampler)
+    std::uint64_t inverse_cdf_hash;
+    // Tuples [first_tuple, last_tuple) of the run
+    std::size_t first_tuple;
+    std::size_t last_tuple;
+    // SamplingMode (zero: independent)
+    std::uint32_t sampling_mode;
+};
+
+// Where a run's checkpoint of a PDF is kept
+template <typename PDF>
+class CheckpointStore {
+
+public:
+
+    virtual ~CheckpointStore() = default;
+
+    // Is there a checkpoint to resume from?
+    virtual bool exists() const = 0;
+
+    // Replaces the counts of pdf with those of the checkpoint and returns its
+    // metadata
+    virtual CheckpointInfo read(PDF & pdf) const = 0;
+
+    // Replaces the checkpoint with the counts of pdf
+    virtual void write(PDF const & pdf, CheckpointInfo const & info) = 0;
+
+    // For error messages
+    virtual std::string const & name() const = 0;
+
+};
+
+// A checkpoint file (see PDFCheckpoint.hpp)
+template <typename PDF>
+class CheckpointFile;
+
+// ============================================================================
+// Export
+
+// Takes the normalized tuples of a sampler, a block at a time, from any number
+// of threads
+template <typename Float, std::size_t N_SUM>
+class TupleSink {
+
+public:
+
+    // A block being filled by a worker thread
+    struct Block {
+        std::uint32_t index;
+        // Room for capacity tuples of N_SUM values
+        Float * tuples;
+        std::size_t capacity;
+    };
+
+    virtual ~TupleSink() = default;
+
+    virtual std::size_t block_tuples() const = 0;
+
+    // A free block to fill
+    virtual Block acquire() = 0;
+
+    // Hands a block holding the tuples [first_tuple, first_tuple + n) back
+    virtual void submit(Block const & block, std::uint64_t first_tuple,
+            std::uint64_t n) = 0;
+
+};
+
+// Streams the tuples to a file (see SampleExporter.hpp)
+template <typename Float, std::size_t N_SUM>
+class SampleExporter;
+
+#endif // SAMPLER_HOOKS_HPP
@@ -0,0 +1,193 @@
+#ifndef SAMPLER_STATS_HPP
+#define SAMPLER_STATS_HPP
+
+// Run statistics of ProbabilitySampler::generate().
+//
+// Compile with SAMPLER_STATS defined to 1 to collect them; otherwise every
+// hook below is an empty inline function behind `if constexpr` and the hot
+// loop is unchanged.
+// -- Each worker thread counts into its own cache line (ThreadCounters), so
+//    the counters need no atomics.
+// -- Times are taken with the time-stamp counter (one rdtsc per phase of a
+//    block of tuples) and converted to seconds against the wall clock at the
+//    end of the run.
+// -- The edge cases counted are the ones the nextafter nudges exist for:
+//    draws below the smallest normal number (zero_draws; raised to it) and
+//    normalized values that came out at one or more (unit_values; nudged
+//    below one).  All other nudges move a value by one ulp and are not
+//    counted.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifndef SAMPLER_STATS
+#define SAMPLER_STATS 0
+#endif
+
+// ============================================================================
+// Counters of one worker thread
+
+struct alignas(64) ThreadCounters {
+    std::uint64_t tuples{0};
+    std::uint64_t zero_draws{0};
+    std::uint64_t unit_values{0};
+    // Ticks spent per phase of sampling a block
+    std::uint64_t draw_ticks{0};
+    std::uint64_t inverse_cdf_ticks{0};
+    std::uint64_t normalize_ticks{0};
+    std::uint64_t deposit_ticks{0};
+};
+
+namespace sampler_stats_ {
+
+constexpr bool ENABLED = SAMPLER_STATS != 0;
+
+inline std::uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+// Start timing phases (zero if disabled or c is null)
+inline std::uint64_t start(ThreadCounters const * c) {
+    if constexpr (ENABLED) {
+        if (c != nullptr) {
+            return ticks();
+        }
+    }
+    return 0;
+}
+
+inline std::uint64_t start() {
+    if constexpr (ENABLED) {
+        return ticks();
+    }
+    return 0;
+}
+
+// Add the ticks since last to c->*phase and restart from now
+inline void lap(ThreadCounters * c, std::uint64_t ThreadCounters::* phase,
+        std::uint64_t & last) {
+    if constexpr (ENABLED) {
+        if (c != nullptr) {
+            std::uint64_t now = ticks();
+            c->*phase += now - last;
+            last = now;
+        }
+    }
+}
+
+// Add the ticks since last to total and restart from now
+inline void lap(std::uint64_t & total, std::uint64_t & last) {
+    if constexpr (ENABLED) {
+        std::uint64_t now = ticks();
+        total += now - last;
+        last = now;
+    }
+}
+
+// Add n (or one for a true event) to c->*counter
+inline void add(ThreadCounters * c, std::uint64_t ThreadCounters::* counter,
+        std::uint64_t const n) {
+    if constexpr (ENABLED) {
+        if (c != nullptr) {
+            c->*counter += n;
+        }
+    }
+}
+
+} // end namespace sampler_stats_
+
+// ============================================================================
+// Statistics of one run
+
+struct SamplerStats {
+
+    struct Thread {
+        std::uint64_t tuples;
+        // Time spent sampling
+        double seconds;
+        double tuples_per_second;
+    };
+
+    // One consultation of the stopping rule
+    struct Round {
+        // Tuples sampled before it
+        std::uint64_t tuples;
+        // Deposits it asked for (zero ends the run)
+        std::uint64_t deposits_requested;
+        // Since the start of the run
+        double seconds;
+    };
+
+    // False unless compiled with SAMPLER_STATS
+    bool enabled{sampler_stats_::ENABLED};
+
+    std::uint64_t tuples{0};
+    std::uint64_t deposits{0};
+    std::uint64_t zero_draws{0};
+    std::uint64_t unit_values{0};
+
+    // Wall time of the run, and time per phase summed over threads
+    double seconds{0};
+    double draw_seconds{0};
+    double inverse_cdf_seconds{0};
+    double normalize_seconds{0};
+    double deposit_seconds{0};
+    double reduce_seconds{0};
+    double stopping_rule_seconds{0};
+    double checkpoint_seconds{0};
+
+    double ticks_per_second{0};
+
+    std::vector<Thread> threads;
+    std::vector<Round> rounds;
+
+    std::string to_json() const {
+        std::ostringstream ss;
+        ss.precision(9);
+        ss << "{\"enabled\":" << (enabled ? "true" : "false")
+            << ",\"tuples\":" << tuples
+            << ",\"deposits\":" << deposits
+            << ",\"zero_draws\":" << zero_draws
+            << ",\"unit_values\":" << unit_values
+            << ",\"seconds\":{\"total\":" << seconds
+            << ",\"draw\":" << draw_seconds
+            << ",\"inverse_cdf\":" << inverse_cdf_seconds
+            << ",\"normalize\":" << normalize_seconds
+            << ",\"deposit\":" << deposit_seconds
+            << ",\"reduce\":" << reduce_seconds
+            << ",\"stopping_rule\":" << stopping_rule_seconds
+            << ",\"checkpoint\":" << checkpoint_seconds
+            << "},\"ticks_per_second\":" << ticks_per_second
+            << ",\"threads\":[";
+        for (std::size_t t = 0; t < threads.size(); t++) {
+            ss << (t > 0 ? "," : "") << "{\"tuples\":" << threads[t].tuples
+                << ",\"seconds\":" << threads[t].seconds
+                << ",\"tuples_per_second\":" << threads[t].tuples_per_second
+                << "}";
+        }
+        ss << "],\"rounds\":[";
+        for (std::size_t r = 0; r < rounds.size(); r++) {
+            ss << (r > 0 ? "," : "") << "{\"tuples\":" << rounds[r].tuples
+                << ",\"deposits_requested\":" << rounds[r].deposits_requested
+                << ",\"seconds\":" << rounds[r].seconds << "}";
+        }
+        ss << "]}";
+        return ss.str();
+    }
+
+};
+
+#endif // SAMPLER_STATS_HPP
@@ -0,0 +1,126 @@
+#ifndef SAMPLING_MODES_HPP
+#define SAMPLING_MODES_HPP
+
+// Variance-reduction modes for the uniforms of ProbabilitySampler's tuples.
+//
+// Each mode rewrites the uniforms a block of tuples was drawn with, before
+// the inverse CDF; nothing else in the sampler changes.  Every tuple still
+// draws its own N_SUM uniforms from the RNG, so the random sequence and its
+// chunking stay as they are, and a mode's output depends only on the seed,
+// the stream and the tuple indices (not on threads or block boundaries).
+// -- independent    : the uniforms as drawn.
+// -- antithetic     : tuples come in pairs (2k, 2k+1); the second reuses the
+//                     first's uniforms reflected, u -> 1 - u.
+// -- stratified     : the first component of tuple t is confined to stratum
+//                     t mod N_BINS of [0,1), so every N_BINS consecutive
+//                     tuples cover the strata once each.
+// -- latin_hypercube: tuples come in groups of G (N_BINS rounded up to a
+//                     power of two); within a group every component visits
+//                     each of the G strata once, in an order given by a
+//                     keyed permutation per group and component.
+// Values pushed to one by rounding are kept just below it.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// ============================================================================
+
+enum class SamplingMode : std::uint32_t {
+    independent = 0,
+    antithetic = 1,
+    stratified = 2,
+    latin_hypercube = 3
+};
+
+namespace sampling_modes_ {
+
+// Tuples that have to be drawn together: a piece of a run starting inside a
+// group draws from the start of the group.
+inline std::size_t group(SamplingMode const mode) {
+    return mode == SamplingMode::antithetic ? 2 : 1;
+}
+
+inline std::uint64_t mix(std::uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// A permutation of [0, 2^bits) chosen by key: odd multiplications and
+// xor-shifts are invertible modulo 2^bits.
+inline std::uint64_t permute(std::uint64_t x, std::uint64_t const key,
+        unsigned const bits) {
+    std::uint64_t mask = (std::uint64_t(1) << bits) - 1;
+    unsigned shift = (bits + 1) / 2;
+    x ^= key & mask;
+    x = (x * ((key >> 16) | 1)) & mask;
+    x ^= x >> shift;
+    x = (x * ((key >> 32) | 1)) & mask;
+    x ^= x >> shift;
+    return x ^ ((key >> 48) & mask);
+}
+
+// Rewrites the uniforms u[0, n N_SUM) of the tuples [first, first + n) into
+// out (may equal u).  key identifies the run (seed and stream).
+template <typename Float, std::size_t N_SUM, std::size_t N_BINS>
+void apply(SamplingMode const mode, Float const * u, Float * out,
+        std::size_t const first, std::size_t const n, std::uint64_t const key) {
+    Float const below_one = std::nextafter(Float{1}, Float{0});
+    switch (mode) {
+    case SamplingMode::independent:
+        std::copy(u, u + n * N_SUM, out);
+        break;
+    case SamplingMode::antithetic:
+        // Odd tuples reflect the even tuple before them (the caller draws
+        // from an even tuple, so the first tuple here is never odd)
+        for (std::size_t t = 0; t < n; t++) {
+            for (std::size_t i = 0; i < N_SUM; i++) {
+                out[t * N_SUM + i] = (first + t) % 2 == 0 ? u[t * N_SUM + i]
+                    : std::min(Float{1} - u[(t - 1) * N_SUM + i], below_one);
+            }
+        }
+        break;
+    case SamplingMode::stratified: {
+        Float scale = Float{1} / Float(N_BINS);
+        std::copy(u, u + n * N_SUM, out);
+        for (std::size_t t = 0; t < n; t++) {
+            Float stratum = Float((first + t) % N_BINS);
+            out[t * N_SUM] = std::min((stratum + u[t * N_SUM]) * scale,
+                    below_one);
+        }
+        break;
+    }
+    case SamplingMode::latin_hypercube: {
+        unsigned bits = 0;
+        while ((std::size_t(1) << bits) < N_BINS) {
+            bits++;
+        }
+        std::uint64_t size = std::uint64_t(1) << bits;
+        Float scale = Float{1} / Float(size);
+        std::uint64_t keys[N_SUM] = {};
+        std::uint64_t current = ~std::uint64_t(0);
+        for (std::size_t t = 0; t < n; t++) {
+            std::uint64_t g = (first + t) >> bits;
+            if (g != current) {
+                current = g;
+                for (std::size_t i = 0; i < N_SUM; i++) {
+                    keys[i] = mix(key ^ mix(g * N_SUM + i));
+                }
+            }
+            std::uint64_t j = (first + t) & (size - 1);
+            for (std::size_t i = 0; i < N_SUM; i++) {
+                Float stratum = Float(permute(j, keys[i], bits));
+                out[t * N_SUM + i] = std::min(
+                        (stratum + u[t * N_SUM + i]) * scale, below_one);
+            }
+        }
+        break;
+    }
+    }
+}
+
+} // end namespace sampling_modes_
+
+#endif // SAMPLING_MODES_HPP
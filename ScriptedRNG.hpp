@@ -0,0 +1,42 @@
+#ifndef SCRIPTED_RNG_HPP
+#define SCRIPTED_RNG_HPP
+
+// A fake "random" number generator policy for ProbabilitySampler that just
+// replays a fixed list of values (cycling when it runs out).  Feeding it
+// edge-case values reliably demonstrates whether or not the sampler handles
+// them as expected.
+//
+// Script must provide a static values() returning a container of Float in
+// [0,1).
+
+#include <cstddef>
+#include <cstdint>
+
+// ============================================================================
+
+template <typename Float, typename Script>
+struct ScriptedRNG {
+
+    struct engine_type {
+        std::uint64_t position;
+    };
+
+    static constexpr bool seekable = true;
+
+    // Every stream replays the same script.
+    static engine_type make_engine(std::uint64_t const, std::uint64_t const) {
+        return engine_type{0};
+    }
+
+    static void skip(engine_type & engine, std::uint64_t const n) {
+        engine.position += n;
+    }
+
+    static Float uniform(engine_type & engine) {
+        auto const & values = Script::values();
+        return values[engine.position++ % values.size()];
+    }
+
+};
+
+#endif // SCRIPTED_RNG_HPP
@@ -0,0 +1,235 @@
+#ifndef SHARD_RUNNER_HPP
+#define SHARD_RUNNER_HPP
+
+// Runs one seeded ProbabilitySampler job across several local processes.
+//
+// -- The tuples of the run are cut into one contiguous range per process, on
+//    chunk boundaries, so every process draws its own disjoint part of the
+//    random sequence (see ProbabilitySampler::sample_range).  The summed PDF
+//    is therefore the one generate() gives with FixedCount(n_deposits), for
+//    any number of processes.
+// -- Each process (fork) deposits into its own PDF, then copies the counts
+//    into its slot of a shared anonymous mapping (POSIX mmap) and exits.  The
+//    launcher waits for all of them and adds up the slots: one pass over
+//    processes x N_BINS counters, against the sampling of all the deposits.
+// -- A process that dies (crash, signal, out of memory) takes only its own
+//    range with it; the range is run again in a fresh process, up to
+//    retries times, before run() gives up with std::runtime_error.
+// -- The same ranges can be run on other nodes instead, each writing a
+//    checkpoint file (run_part), and combined with merge_checkpoints.
+//
+// Fork from a point where no other threads are running: the sampler's own
+// worker threads only exist inside generate().
+
+#include "PDFCheckpoint.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// ============================================================================
+
+template <typename Sampler>
+class ShardRunner {
+
+    // ------------------------------------------------------------------------
+    // Types
+
+public:
+
+    using PDF = typename Sampler::PDF;
+
+private:
+
+    // A process's slot in the shared mapping: its bins
+    static constexpr std::size_t SLOT_WORDS_ = PDF::n_bins();
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // n_processes processes (at least one); each failed range is run again
+    // up to retries times.
+    explicit ShardRunner(std::size_t const n_processes,
+            std::size_t const retries = 1)
+        : n_processes_(std::max<std::size_t>(1, n_processes))
+        , retries_(retries)
+    {
+    }
+
+    // ------------------------------------------------------------------------
+    // Ranges
+
+public:
+
+    // Tuples [first, last) of part p of n_parts of a run of n_tuples tuples
+    // (cut on chunk boundaries, so the parts share no chunk)
+    static std::array<std::size_t, 2> part(std::size_t const p,
+            std::size_t const n_parts, std::size_t const n_tuples) {
+        std::size_t chunk = Sampler::chunk_tuples();
+        std::size_t n_chunks = (n_tuples + chunk - 1) / chunk;
+        std::size_t first = std::min(n_tuples, p * n_chunks / n_parts * chunk);
+        std::size_t last = std::min(n_tuples,
+                (p + 1) * n_chunks / n_parts * chunk);
+        return {first, last};
+    }
+
+    // ------------------------------------------------------------------------
+    // Run
+
+private:
+
+    // Fork a process that samples [first, last) into slot
+    static pid_t launch_(Sampler const & sampler, std::size_t const first,
+            std::size_t const last, std::uint64_t * slot) {
+        pid_t pid = ::fork();
+        if (pid < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                    "ShardRunner: fork");
+        }
+        if (pid > 0) {
+            return pid;
+        }
+        // Child: sample, publish, and leave without running the parent's
+        // exit handlers
+        int status = 0;
+        try {
+            auto pdf = std::make_unique<PDF>();
+            typename Sampler::Buffer buffer;
+            sampler.sample_range(first, last, *pdf, buffer);
+            auto const & bins = pdf->get_all_bins();
+            for (std::size_t n = 0; n < PDF::n_bins(); n++) {
+                slot[n] = std::uint64_t(bins[n]);
+            }
+        } catch (...) {
+            status = 1;
+        }
+        ::_exit(status);
+    }
+
+    static bool succeeded_(pid_t const pid) {
+        int status;
+        while (::waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+public:
+
+    // The PDF of the sampler's seeded run with FixedCount(n_deposits)
+    PDF run(Sampler const & sampler, std::size_t const n_deposits) const {
+        PDF pdf;
+        run(sampler, n_deposits, pdf);
+        return pdf;
+    }
+
+    // The same into pdf (cleared first), which the caller may keep on the
+    // heap: at 2^20 bins and more a PDF is too big for the stack.
+    void run(Sampler const & sampler, std::size_t const n_deposits,
+            PDF & pdf) const {
+        std::size_t n_tuples = Sampler::tuples_for(n_deposits);
+        std::size_t bytes = n_processes_ * SLOT_WORDS_ * sizeof(std::uint64_t);
+        void * p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(),
+                    "ShardRunner: map");
+        }
+        auto slots = static_cast<std::uint64_t *>(p);
+
+        // Launch every range, wait for all of them, then run failed ranges
+        // again one at a time
+        // (zero once waited for)
+        std::vector<pid_t> pids(n_processes_, 0);
+        std::vector<bool> done(n_processes_);
+        try {
+            for (std::size_t s = 0; s < n_processes_; s++) {
+                auto range = part(s, n_processes_, n_tuples);
+                pids[s] = launch_(sampler, range[0], range[1],
+                        slots + s * SLOT_WORDS_);
+            }
+            for (std::size_t s = 0; s < n_processes_; s++) {
+                done[s] = succeeded_(pids[s]);
+                pids[s] = 0;
+            }
+            for (std::size_t s = 0; s < n_processes_; s++) {
+                for (std::size_t t = 0; !done[s]; t++) {
+                    if (t == retries_) {
+                        throw std::runtime_error("ShardRunner: range "
+                                + std::to_string(s) + " failed");
+                    }
+                    std::memset(slots + s * SLOT_WORDS_, 0,
+                            SLOT_WORDS_ * sizeof(std::uint64_t));
+                    auto range = part(s, n_processes_, n_tuples);
+                    done[s] = succeeded_(launch_(sampler, range[0], range[1],
+                            slots + s * SLOT_WORDS_));
+                }
+            }
+        } catch (...) {
+            // A launch failed part way: stop and reap the processes already
+            // running, so none is left behind as a zombie
+            for (pid_t const pid : pids) {
+                if (pid > 0) {
+                    ::kill(pid, SIGKILL);
+                    succeeded_(pid);
+                }
+            }
+            ::munmap(p, bytes);
+            throw;
+        }
+
+        // Reduce
+        pdf.clear();
+        for (std::size_t n = 0; n < PDF::n_bins(); n++) {
+            std::uint64_t sum = 0;
+            for (std::size_t s = 0; s < n_processes_; s++) {
+                sum += slots[s * SLOT_WORDS_ + n];
+            }
+            pdf.add_to_bin(n, sum);
+        }
+        ::munmap(p, bytes);
+    }
+
+    // Part p of n_parts of the same run, in this process, written to a
+    // checkpoint file (for runs spread over several nodes; combine the parts
+    // with merge_checkpoints).
+    static void run_part(Sampler const & sampler, std::size_t const n_deposits,
+            std::size_t const p, std::size_t const n_parts,
+            std::string const & path) {
+        auto range = part(p, n_parts, Sampler::tuples_for(n_deposits));
+        auto pdf = std::make_unique<PDF>();
+        typename Sampler::Buffer buffer;
+        sampler.sample_range(range[0], range[1], *pdf, buffer);
+        write_checkpoint(path, *pdf,
+                sampler.checkpoint_info(range[0], range[1]));
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    std::size_t n_processes_;
+    std::size_t retries_;
+
+};
+
+#endif // SHARD_RUNNER_HPP
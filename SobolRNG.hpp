@@ -0,0 +1,205 @@
+#ifndef SOBOL_RNG_HPP
+#define SOBOL_RNG_HPP
+
+// Quasi-Monte Carlo "RNG" policy for ProbabilitySampler.
+//
+// Successive calls to uniform() walk through the coordinates of a
+// DIM-dimensional Sobol sequence, one point per N_SUM-tuple, so DIM must equal
+// N_SUM.  The sequence is randomized with a nested uniform (Owen) scramble
+// keyed on the seed and stream, so different streams are independent
+// randomized replicates of the same low-discrepancy point set and the spread
+// between them gives error bars (see ProbabilitySampler::generate_replicates).
+//
+// -- Direction numbers: Joe & Kuo, new-joe-kuo-6.21201 (first 12 dimensions).
+// -- Points are generated in Gray-code order, so stepping is one XOR per
+//    coordinate and seeking to any point is O(32).  There are 2^32 points.
+// -- Scrambling: Burley, "Practical Hash-based Owen Scrambling" (JCGT 2020).
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+// ============================================================================
+
+namespace sobol_rng_ {
+
+constexpr std::size_t MAX_DIM = 12;
+constexpr int BITS = 32;
+
+// Joe-Kuo parameters for dimensions 2 and up: degree s, coefficients a and
+// initial direction numbers m_1..m_s.
+struct JoeKuo {
+    int s;
+    std::uint32_t a;
+    std::array<std::uint32_t, 5> m;
+};
+
+constexpr std::array<JoeKuo, MAX_DIM - 1> JOE_KUO{{
+    {1, 0, {1}},
+    {2, 1, {1, 3}},
+    {3, 1, {1, 3, 1}},
+    {3, 2, {1, 1, 1}},
+    {4, 1, {1, 1, 3, 3}},
+    {4, 4, {1, 3, 5, 13}},
+    {5, 2, {1, 1, 5, 5, 17}},
+    {5, 4, {1, 1, 5, 5, 5}},
+    {5, 7, {1, 1, 7, 11, 19}},
+    {5, 11, {1, 1, 5, 1, 1}},
+    {5, 13, {1, 1, 1, 3, 11}},
+}};
+
+using Directions = std::array<std::array<std::uint32_t, BITS>, MAX_DIM>;
+
+inline Directions make_directions() {
+    Directions v{};
+    // First dimension: van der Corput
+    for (int k = 0; k < BITS; k++) {
+        v[0][k] = std::uint32_t(1) << (BITS - 1 - k);
+    }
+    for (std::size_t d = 1; d < MAX_DIM; d++) {
+        auto const & jk = JOE_KUO[d-1];
+        int s = jk.s;
+        for (int k = 0; k < s; k++) {
+            v[d][k] = jk.m[k] << (BITS - 1 - k);
+        }
+        for (int k = s; k < BITS; k++) {
+            std::uint32_t x = v[d][k-s] ^ (v[d][k-s] >> s);
+            for (int j = 1; j < s; j++) {
+                if ((jk.a >> (s - 1 - j)) & 1) {
+                    x ^= v[d][k-j];
+                }
+            }
+            v[d][k] = x;
+        }
+    }
+    return v;
+}
+
+inline Directions const & directions() {
+    static Directions const v = make_directions();
+    return v;
+}
+
+inline std::uint32_t reverse_bits(std::uint32_t x) {
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// Nested uniform scramble: a hash in which every bit only depends on the
+// bits below it, applied to the bit-reversed value
+inline std::uint32_t owen_scramble(std::uint32_t x, std::uint32_t const seed) {
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+inline std::uint32_t hash(std::uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return std::uint32_t(x);
+}
+
+} // end namespace sobol_rng_
+
+// ============================================================================
+
+template <typename Float, typename std::size_t DIM>
+struct SobolRNG {
+
+    static_assert(DIM >= 1 && DIM <= sobol_rng_::MAX_DIM,
+            "SobolRNG supports 1 to 12 dimensions");
+
+    static constexpr std::size_t dimension = DIM;
+
+    struct engine_type {
+        // Index of the current point and coordinate within it
+        std::uint64_t index;
+        std::size_t coordinate;
+        // Unscrambled current point
+        std::array<std::uint32_t, DIM> point;
+        // Scrambling seed per dimension
+        std::array<std::uint32_t, DIM> scramble;
+    };
+
+    static constexpr bool seekable = true;
+
+    static engine_type make_engine(
+            std::uint64_t const seed, std::uint64_t const stream) {
+        engine_type engine;
+        for (std::size_t d = 0; d < DIM; d++) {
+            engine.scramble[d] = sobol_rng_::hash(
+                    seed ^ sobol_rng_::hash(stream * DIM + d + 1));
+        }
+        seek_(engine, 0);
+        engine.coordinate = 0;
+        return engine;
+    }
+
+    static void skip(engine_type & engine, std::uint64_t const n) {
+        std::uint64_t position = engine.index * DIM + engine.coordinate + n;
+        seek_(engine, position / DIM);
+        engine.coordinate = position % DIM;
+    }
+
+    static Float uniform(engine_type & engine) {
+        std::size_t d = engine.coordinate;
+        std::uint32_t x = sobol_rng_::owen_scramble(engine.point[d],
+                engine.scramble[d]);
+        if (++engine.coordinate == DIM) {
+            engine.coordinate = 0;
+            step_(engine);
+        }
+        if constexpr (std::is_same<Float, float>::value) {
+            return float(x >> 8) * 0x1p-24f;
+        } else {
+            return double(x) * 0x1p-32;
+        }
+    }
+
+private:
+
+    // Point i in Gray-code order is the XOR of the directions for the set
+    // bits of i ^ (i >> 1).
+    static void seek_(engine_type & engine, std::uint64_t const index) {
+        assert(index >> sobol_rng_::BITS == 0);
+        auto const & v = sobol_rng_::directions();
+        std::uint64_t gray = index ^ (index >> 1);
+        for (std::size_t d = 0; d < DIM; d++) {
+            std::uint32_t x = 0;
+            for (int k = 0; k < sobol_rng_::BITS; k++) {
+                if ((gray >> k) & 1) {
+                    x ^= v[d][k];
+                }
+            }
+            engine.point[d] = x;
+        }
+        engine.index = index;
+    }
+
+    // Moving from point i to i + 1 flips the direction for the lowest zero
+    // bit of i.
+    static void step_(engine_type & engine) {
+        auto const & v = sobol_rng_::directions();
+        int k = __builtin_ctzll(~engine.index);
+        assert(k < sobol_rng_::BITS);
+        for (std::size_t d = 0; d < DIM; d++) {
+            engine.point[d] ^= v[d][k];
+        }
+        engine.index++;
+    }
+
+};
+
+#endif // SOBOL_RNG_HPP
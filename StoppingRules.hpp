@@ -0,0 +1,144 @@
+#ifndef STOPPING_RULES_HPP
+#define STOPPING_RULES_HPP
+
+// Stopping rules for ProbabilitySampler -- how long to keep sampling?
+//
+// A stopping rule is a callable taking the output PDF built so far and
+// returning how many more deposits to make before it is consulted again.
+// Zero stops sampling.  The rule is only consulted between rounds of
+// samples, so it stays off the per-sample hot path.
+//
+// The desired output is a uniform PDF with uniform binning, so every bin
+// should end up with count / N_BINS deposits; the rules below measure the
+// statistics and the error against that.  The PDF keeps those statistics up
+// to date as it is filled (see BinnedPDF), so checking them is cheap and
+// rules can be consulted often.
+//
+// Rules are copied into the sampler.  To inspect one afterwards (e.g. to see
+// whether DivergenceAbort fired), pass it in with std::ref.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+// ============================================================================
+// Fixed number of deposits
+
+class FixedCount {
+
+private:
+
+    std::size_t n_deposits_;
+
+public:
+
+    explicit FixedCount(std::size_t const n_deposits)
+        : n_deposits_(n_deposits)
+    {
+    }
+
+    template <typename PDF>
+    std::size_t operator()(PDF const & pdf) const {
+        std::size_t count = pdf.count();
+        return count < n_deposits_ ? n_deposits_ - count : 0;
+    }
+
+};
+
+// ============================================================================
+// Per-bin relative error target
+// -- The relative error of a bin with c counts is about 1/sqrt(c), so
+//    sampling stops once the emptiest bin has at least 1/target^2 counts (or
+//    once max_deposits have been made).
+
+class RelativeError {
+
+private:
+
+    double target_;
+    std::size_t check_interval_;
+    std::size_t max_deposits_;
+
+public:
+
+    RelativeError(double const target,
+            std::size_t const check_interval = std::size_t{1} << 17,
+            std::size_t const max_deposits = std::numeric_limits<std::size_t>::max())
+        : target_(target)
+        , check_interval_(check_interval)
+        , max_deposits_(max_deposits)
+    {
+    }
+
+    template <typename PDF>
+    std::size_t operator()(PDF const & pdf) const {
+        std::size_t count = pdf.count();
+        if (count >= max_deposits_) {
+            return 0;
+        }
+        if (count > 0) {
+            if (double(pdf.min_count()) * target_ * target_ >= 1.0) {
+                return 0;
+            }
+        }
+        return std::min(check_interval_, max_deposits_ - count);
+    }
+
+};
+
+// ============================================================================
+// Divergence abort
+// -- Wraps another rule.  Once at least min_deposits have been made, sampling
+//    stops early if any bin is off from the uniform expectation by more than
+//    max_deviation (as a fraction of the expected count).  A bad initial
+//    guess can then be handed back to an optimizer after a rough estimate
+//    instead of a full run.
+
+template <typename Rule>
+class DivergenceAbort {
+
+private:
+
+    Rule rule_;
+    double max_deviation_;
+    std::size_t min_deposits_;
+    std::size_t check_interval_;
+    bool aborted_;
+
+public:
+
+    DivergenceAbort(Rule rule, double const max_deviation,
+            std::size_t const min_deposits,
+            std::size_t const check_interval = std::size_t{1} << 17)
+        : rule_(rule)
+        , max_deviation_(max_deviation)
+        , min_deposits_(min_deposits)
+        , check_interval_(check_interval)
+        , aborted_(false)
+    {
+    }
+
+    // Did the last run stop because of the divergence check?
+    bool aborted() const {
+        return aborted_;
+    }
+
+    template <typename PDF>
+    std::size_t operator()(PDF const & pdf) {
+        std::size_t count = pdf.count();
+        if (count == 0) {
+            aborted_ = false;
+        }
+        if (count >= min_deposits_) {
+            if (double(pdf.max_deviation()) > max_deviation_) {
+                aborted_ = true;
+                return 0;
+            }
+        }
+        return std::min(check_interval_, std::size_t(rule_(pdf)));
+    }
+
+};
+
+#endif // STOPPING_RULES_HPP
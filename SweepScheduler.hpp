@@ -0,0 +1,216 @@
+#ifndef SWEEP_SCHEDULER_HPP
+#define SWEEP_SCHEDULER_HPP
+
+// Runs many independent sampling jobs in one process.
+//
+// Each job is a (deposit_all, N_SUM, N_BINS, inverse CDF, deposits, seed)
+// configuration run with DynamicProbabilitySampler.  Jobs are cut into tasks
+// of a few chunks of tuples (see ProbabilitySampler::sample_range) and the
+// tasks of all jobs go on one WorkStealingPool, so short and long jobs
+// balance and every worker stays busy until the last task.  Each finished
+// job's PDF is handed to a callback straight away, in completion order.
+//
+// A job's result depends only on its own configuration: the tasks sample
+// disjoint tuple ranges of one run with the job's seed, so the PDF equals
+// what DynamicProbabilitySampler::generate() gives with FixedCount(deposits),
+// for any number of threads and any task size.
+//
+// Job list format (read_jobs): one job per line, '#' starts a comment,
+//     name deposit_all n_sum n_bins n_deposits seed [points...]
+// where deposit_all is 0 or 1 and the optional points are the inverse CDF at
+// the interior bin edges of any uniform resolution (interpolated to n_bins as
+// by DynamicPiecewiseLinearFunction).  No points means the identity.
+
+#include "DynamicPiecewiseLinearFunction.hpp"
+#include "DynamicProbabilitySampler.hpp"
+#include "WorkStealingPool.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// ============================================================================
+
+template <
+    typename Float = double,
+    typename RNG = XoshiroBlockRNG<Float>,
+    typename SumSizes = SizeList<1, 2, 3, 4>,
+    typename BinSizes = SizeList<16, 64, 256, 1024>>
+class SweepScheduler {
+
+    // ------------------------------------------------------------------------
+    // Types
+
+public:
+
+    using Sampler = DynamicProbabilitySampler<Float, RNG, SumSizes, BinSizes>;
+    using PDF = typename Sampler::PDF;
+
+    struct Job {
+        std::string name;
+        bool deposit_all;
+        std::size_t n_sum;
+        std::size_t n_bins;
+        std::size_t n_deposits;
+        std::uint64_t seed;
+        // Inverse CDF at interior bin edges (any resolution; empty is the
+        // identity)
+        std::vector<Float> points;
+    };
+
+    struct Result {
+        // Position of the job in the list
+        std::size_t index;
+        Job const * job;
+        PDF pdf;
+        // Time from the job's first task starting to its last task ending
+        double seconds;
+    };
+
+    // Called once per job as it finishes, one call at a time
+    using Callback = std::function<void(Result const &)>;
+
+private:
+
+    // Per-job bookkeeping while the sweep runs
+    struct State_ {
+        std::once_flag set_up;
+        std::unique_ptr<Sampler> sampler;
+        std::mutex mutex;
+        PDF pdf;
+        std::size_t tasks_left;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // n_threads workers (0 means one per core); tasks of task_chunks chunks
+    explicit SweepScheduler(std::size_t const n_threads = 0,
+            std::size_t const task_chunks = 4)
+        : pool_(n_threads)
+        , task_tuples_(task_chunks * Sampler::chunk_tuples())
+        , buffers_(pool_.n_threads())
+        , scratch_(pool_.n_threads())
+    {
+    }
+
+    // ------------------------------------------------------------------------
+    // Job list
+
+public:
+
+    static std::vector<Job> read_jobs(std::istream & in) {
+        std::vector<Job> jobs;
+        std::string line;
+        while (std::getline(in, line)) {
+            line = line.substr(0, line.find('#'));
+            std::istringstream ss(line);
+            Job job;
+            int deposit_all;
+            if (!(ss >> job.name >> deposit_all >> job.n_sum >> job.n_bins
+                        >> job.n_deposits >> job.seed)) {
+                continue;
+            }
+            job.deposit_all = deposit_all != 0;
+            Float x;
+            while (ss >> x) {
+                job.points.push_back(x);
+            }
+            jobs.push_back(std::move(job));
+        }
+        return jobs;
+    }
+
+    // ------------------------------------------------------------------------
+    // Run
+
+private:
+
+    // Build the job's sampler (on the first task to reach it)
+    static void set_up_(Job const & job, State_ & state) {
+        DynamicPiecewiseLinearFunction<Float> inverse_cdf(job.n_bins, job.points);
+        state.sampler = std::make_unique<Sampler>(job.deposit_all, job.n_sum,
+                inverse_cdf);
+        state.sampler->set_seed(job.seed);
+        state.start = std::chrono::steady_clock::now();
+    }
+
+    void run_task_(std::size_t const index, Job const & job, State_ & state,
+            std::size_t const first, std::size_t const last,
+            std::size_t const worker, Callback const & on_result) {
+        std::call_once(state.set_up, [&]() { set_up_(job, state); });
+        PDF & partial = scratch_[worker];
+        partial.resize(job.n_bins);
+        state.sampler->sample_range(first, last, partial, buffers_[worker]);
+
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.pdf += partial;
+        if (--state.tasks_left > 0) {
+            return;
+        }
+        Result result;
+        result.index = index;
+        result.job = &job;
+        result.pdf = std::move(state.pdf);
+        result.seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - state.start).count();
+        state.sampler.reset();
+        std::lock_guard<std::mutex> output_lock(output_mutex_);
+        on_result(result);
+    }
+
+public:
+
+    // Runs all jobs and returns once the last result has been handed over.
+    void run(std::vector<Job> const & jobs, Callback const & on_result) {
+        std::vector<State_> states(jobs.size());
+        for (std::size_t j = 0; j < jobs.size(); j++) {
+            auto const & job = jobs[j];
+            auto & state = states[j];
+            state.pdf.resize(job.n_bins);
+            std::size_t per_tuple = job.deposit_all ? job.n_sum : 1;
+            std::size_t n_tuples = (job.n_deposits + per_tuple - 1) / per_tuple;
+            state.tasks_left = std::max<std::size_t>(1,
+                    (n_tuples + task_tuples_ - 1) / task_tuples_);
+            for (std::size_t first = 0; first < n_tuples || first == 0;
+                    first += task_tuples_) {
+                std::size_t last = std::min(n_tuples, first + task_tuples_);
+                pool_.submit([&, j, first, last](std::size_t worker) {
+                    run_task_(j, jobs[j], states[j], first, last, worker,
+                            on_result);
+                });
+            }
+        }
+        pool_.wait();
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    WorkStealingPool pool_;
+    std::size_t task_tuples_;
+
+    // Work space per worker
+    std::vector<std::vector<Float>> buffers_;
+    std::vector<PDF> scratch_;
+
+    std::mutex output_mutex_;
+
+};
+
+#endif // SWEEP_SCHEDULER_HPP
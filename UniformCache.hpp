@@ -0,0 +1,198 @@
+#ifndef UNIFORM_CACHE_HPP
+#define UNIFORM_CACHE_HPP
+
+// Stored uniforms for common random numbers.
+//
+// Between optimizer iterations only the inverse CDF changes.  A sampler with
+// a cache (ProbabilitySampler::set_uniform_cache) records the N_SUM-tuples of
+// uniforms it draws the first time through and replays them on every later
+// call to generate(), so the RNG cost is paid once and the difference between
+// two iterations' output PDFs is due to the inverse CDFs alone, not to
+// different draws.
+//
+// -- The cache holds the first capacity() tuples of one run, in tuple order.
+//    Tuples past the capacity are drawn from the RNG as usual, with the seed
+//    and stream the cache was recorded with, so a run is the same with or
+//    without a cache and with any capacity.
+// -- The storage is either an in-memory array or a file mapped into memory
+//    (POSIX mmap), which lets a cache larger than RAM be paged in by the OS.
+//    Only the in-memory array is built off POSIX (UNIFORM_CACHE_FILE is 0).
+//    The file is scratch space for this process only: it is truncated when
+//    the cache is made, and the seed, stream and recorded count are not
+//    saved in it, so it cannot be replayed by another process.
+// -- Different blocks of tuples may be recorded by different threads at the
+//    same time; the sampler only marks them as recorded once a round is done.
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define UNIFORM_CACHE_FILE 1
+#else
+#define UNIFORM_CACHE_FILE 0
+#endif
+
+#if UNIFORM_CACHE_FILE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// ============================================================================
+
+template <typename Float, typename std::size_t N_SUM>
+class UniformCache {
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // In-memory cache for up to n_tuples tuples.
+    UniformCache(std::size_t const n_tuples)
+        : memory_(n_tuples * N_SUM)
+        , data_(memory_.data())
+        , capacity_(n_tuples)
+    {
+    }
+
+#if UNIFORM_CACHE_FILE
+
+    // File-backed cache for up to n_tuples tuples.  The file is created (or
+    // truncated) and sized to hold them; its contents are only meaningful to
+    // this cache.
+    UniformCache(std::string const & path, std::size_t const n_tuples)
+        : capacity_(n_tuples)
+    {
+        std::size_t bytes = n_tuples * N_SUM * sizeof(Float);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(),
+                    "UniformCache: open " + path);
+        }
+        if (::ftruncate(fd, off_t(bytes)) != 0) {
+            int err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::generic_category(),
+                    "UniformCache: resize " + path);
+        }
+        if (bytes > 0) {
+            void * p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                int err = errno;
+                ::close(fd);
+                throw std::system_error(err, std::generic_category(),
+                        "UniformCache: map " + path);
+            }
+            data_ = static_cast<Float *>(p);
+            mapped_bytes_ = bytes;
+        }
+        ::close(fd);
+    }
+
+#endif
+
+    UniformCache(UniformCache const &) = delete;
+    UniformCache & operator=(UniformCache const &) = delete;
+
+    ~UniformCache() {
+#if UNIFORM_CACHE_FILE
+        if (mapped_bytes_ > 0) {
+            ::munmap(data_, mapped_bytes_);
+        }
+#endif
+    }
+
+    // ------------------------------------------------------------------------
+    // Recording
+
+public:
+
+    // Has a run been recorded (at least partly)?
+    bool bound() const {
+        return bound_;
+    }
+
+    // Tie the cache to the run with this seed and stream.
+    void bind(std::uint64_t const seed, std::uint64_t const stream) {
+        assert(!bound_);
+        seed_ = seed;
+        stream_ = stream;
+        bound_ = true;
+    }
+
+    std::uint64_t seed() const {
+        return seed_;
+    }
+
+    std::uint64_t stream() const {
+        return stream_;
+    }
+
+    // Mark the first n_tuples tuples as recorded.
+    void set_recorded(std::size_t const n_tuples) {
+        assert(bound_);
+        assert(n_tuples <= capacity_);
+        recorded_ = std::max(recorded_, n_tuples);
+    }
+
+    // Forget the recording (the next run records afresh).
+    void clear() {
+        bound_ = false;
+        recorded_ = 0;
+    }
+
+    // ------------------------------------------------------------------------
+    // Access
+
+public:
+
+    // Number of tuples the cache can hold
+    std::size_t capacity() const {
+        return capacity_;
+    }
+
+    // Number of tuples recorded so far
+    std::size_t recorded() const {
+        return recorded_;
+    }
+
+    // Uniforms of tuple n onwards
+    Float * tuple(std::size_t const n) {
+        assert(n <= capacity_);
+        return data_ + n * N_SUM;
+    }
+
+    Float const * tuple(std::size_t const n) const {
+        assert(n <= capacity_);
+        return data_ + n * N_SUM;
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    // Storage: memory_ for an in-memory cache, otherwise a mapping of
+    // mapped_bytes_ bytes
+    std::vector<Float> memory_;
+    Float * data_{nullptr};
+    std::size_t mapped_bytes_{0};
+    std::size_t capacity_;
+
+    // The recorded run
+    bool bound_{false};
+    std::uint64_t seed_{0};
+    std::uint64_t stream_{0};
+    std::size_t recorded_{0};
+
+};
+
+#endif // UNIFORM_CACHE_HPP
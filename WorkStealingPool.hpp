@@ -0,0 +1,192 @@
+#ifndef WORK_STEALING_POOL_HPP
+#define WORK_STEALING_POOL_HPP
+
+// Fixed-size thread pool with one task queue per worker.
+//
+// -- submit() deals tasks out round-robin over the workers' queues; a task
+//    may submit more tasks (they go to the submitting worker's own queue).
+// -- A worker takes tasks from the front of its own queue, so tasks run
+//    roughly in submission order.  An idle worker steals from the back of
+//    another worker's queue, so work started late in the list moves to
+//    whoever is free and every worker stays busy until the last task.
+// -- wait() blocks until every submitted task has finished.
+// -- Tasks are expected to be coarse (a millisecond or more), so the queues
+//    are plain mutex-protected deques.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ============================================================================
+
+class WorkStealingPool {
+
+    // ------------------------------------------------------------------------
+    // Types
+
+public:
+
+    // A task gets the index of the worker running it (for per-worker
+    // scratch space).
+    using Task = std::function<void(std::size_t)>;
+
+private:
+
+    struct Queue_ {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    // ------------------------------------------------------------------------
+    // Constructors
+
+public:
+
+    // Starts n_threads workers (0 means one per core).
+    explicit WorkStealingPool(std::size_t n_threads = 0) {
+        if (n_threads == 0) {
+            n_threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (std::size_t t = 0; t < n_threads; t++) {
+            queues_.push_back(std::make_unique<Queue_>());
+        }
+        for (std::size_t t = 0; t < n_threads; t++) {
+            workers_.emplace_back([this, t]() { work_(t); });
+        }
+    }
+
+    WorkStealingPool(WorkStealingPool const &) = delete;
+    WorkStealingPool & operator=(WorkStealingPool const &) = delete;
+
+    // Finishes the queued tasks, then stops the workers.
+    ~WorkStealingPool() {
+        wait();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto & w : workers_) {
+            w.join();
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Size
+
+public:
+
+    std::size_t n_threads() const {
+        return workers_.size();
+    }
+
+    // ------------------------------------------------------------------------
+    // Submit tasks and wait for them
+
+public:
+
+    void submit(Task task) {
+        std::size_t q;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_++;
+            q = current_pool_ == this ? current_worker_
+                : next_queue_++ % queues_.size();
+        }
+        {
+            std::lock_guard<std::mutex> lock(queues_[q]->mutex);
+            queues_[q]->tasks.push_back(std::move(task));
+            std::lock_guard<std::mutex> counter_lock(mutex_);
+            queued_++;
+        }
+        wake_.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return pending_ == 0; });
+    }
+
+    // ------------------------------------------------------------------------
+    // Workers
+
+private:
+
+    // Own queue first (front), then the others (back)
+    bool take_(std::size_t const t, Task & task) {
+        std::size_t n = queues_.size();
+        for (std::size_t i = 0; i < n; i++) {
+            auto & queue = *queues_[(t + i) % n];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (i == 0) {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            } else {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            }
+            std::lock_guard<std::mutex> counter_lock(mutex_);
+            queued_--;
+            return true;
+        }
+        return false;
+    }
+
+    void work_(std::size_t const t) {
+        current_pool_ = this;
+        current_worker_ = t;
+        Task task;
+        while (true) {
+            if (take_(t, task)) {
+                task(t);
+                task = nullptr;
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (--pending_ == 0) {
+                    done_.notify_all();
+                }
+                continue;
+            }
+            // Nothing to take: sleep until a task is queued
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this]() { return queued_ > 0 || stopping_; });
+            if (queued_ == 0 && stopping_) {
+                return;
+            }
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Private data
+
+private:
+
+    std::vector<std::unique_ptr<Queue_>> queues_;
+    std::vector<std::thread> workers_;
+
+    // Guards the counters and flags below
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    // -- pending_ : submitted and not yet finished
+    // -- queued_  : submitted and not yet taken by a worker
+    std::size_t pending_{0};
+    std::size_t queued_{0};
+    std::size_t next_queue_{0};
+    bool stopping_{false};
+
+    // Pool and worker index of the worker running on this thread, if any
+    static inline thread_local WorkStealingPool const * current_pool_ = nullptr;
+    static inline thread_local std::size_t current_worker_ = 0;
+
+};
+
+#endif // WORK_STEALING_POOL_HPP
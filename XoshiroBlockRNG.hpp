@@ -0,0 +1,156 @@
+#ifndef XOSHIRO_BLOCK_RNG_HPP
+#define XOSHIRO_BLOCK_RNG_HPP
+
+// Lane-parallel xoshiro256+ RNG policy for ProbabilitySampler.
+//
+// The engine runs LANES independent xoshiro256+ generators side by side, so
+// filling a block of uniforms is a straight-line loop over the lanes that the
+// compiler turns into SIMD code.  The block kernel is dispatched to the best
+// instruction set the CPU supports (see CPUDispatch.hpp); all builds produce
+// identical output.
+//
+// -- Blackman & Vigna, "Scrambled Linear Pseudorandom Number Generators"
+//    (2018).  The "+" scrambler has weak low bits, so only the top bits are
+//    used to build the uniforms.
+
+#include "CPUDispatch.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// ============================================================================
+
+namespace xoshiro_block_rng_ {
+
+constexpr std::size_t LANES = 8;
+
+struct State {
+    alignas(64) std::uint64_t s[4][LANES];
+};
+
+// SplitMix64, used to expand the (seed, stream) pair into lane states
+inline std::uint64_t splitmix64(std::uint64_t & x) {
+    std::uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+inline std::uint64_t rotl(std::uint64_t const x, int const k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Map the top bits of a word to [0,1) by filling the mantissa of a number in
+// [1,2) and subtracting one.  Unlike an integer-to-float conversion this is a
+// shift, an OR and a subtraction, which vectorize on every target.
+inline double to_uniform(std::uint64_t const x, double) {
+    std::uint64_t bits = (x >> 12) | 0x3FF0000000000000ull;
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d - 1.0;
+}
+
+inline float to_uniform(std::uint64_t const x, float) {
+    std::uint32_t bits = std::uint32_t(x >> 41) | 0x3F800000u;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f - 1.0f;
+}
+
+// Advance all lanes n_steps times, writing LANES uniforms per step
+template <typename Float>
+struct Kernel {
+    static inline __attribute__((always_inline))
+    void run(State & state, Float * out, std::size_t const n_steps) {
+        std::uint64_t s0[LANES], s1[LANES], s2[LANES], s3[LANES];
+        for (std::size_t l = 0; l < LANES; l++) {
+            s0[l] = state.s[0][l];
+            s1[l] = state.s[1][l];
+            s2[l] = state.s[2][l];
+            s3[l] = state.s[3][l];
+        }
+        for (std::size_t i = 0; i < n_steps; i++) {
+            for (std::size_t l = 0; l < LANES; l++) {
+                std::uint64_t result = s0[l] + s3[l];
+                std::uint64_t t = s1[l] << 17;
+                s2[l] ^= s0[l];
+                s3[l] ^= s1[l];
+                s1[l] ^= s2[l];
+                s0[l] ^= s3[l];
+                s2[l] ^= t;
+                s3[l] = rotl(s3[l], 45);
+                out[i * LANES + l] = to_uniform(result, Float{});
+            }
+        }
+        for (std::size_t l = 0; l < LANES; l++) {
+            state.s[0][l] = s0[l];
+            state.s[1][l] = s1[l];
+            state.s[2][l] = s2[l];
+            state.s[3][l] = s3[l];
+        }
+    }
+};
+
+} // end namespace xoshiro_block_rng_
+
+// ============================================================================
+
+template <typename Float>
+struct XoshiroBlockRNG {
+
+    static constexpr std::size_t LANES = xoshiro_block_rng_::LANES;
+
+    // Lane states plus one step of buffered output for scalar draws
+    struct engine_type {
+        xoshiro_block_rng_::State state;
+        Float buffer[LANES];
+        std::size_t index;
+    };
+
+    static constexpr bool seekable = false;
+
+    static engine_type make_engine(
+            std::uint64_t const seed, std::uint64_t const stream) {
+        engine_type engine;
+        std::uint64_t mix = stream;
+        std::uint64_t x = seed ^ xoshiro_block_rng_::splitmix64(mix);
+        for (std::size_t l = 0; l < LANES; l++) {
+            for (int w = 0; w < 4; w++) {
+                engine.state.s[w][l] = xoshiro_block_rng_::splitmix64(x);
+            }
+        }
+        engine.index = LANES;
+        return engine;
+    }
+
+    static Float uniform(engine_type & engine) {
+        if (engine.index == LANES) {
+            xoshiro_block_rng_::Kernel<Float>::run(engine.state, engine.buffer,
+                    1);
+            engine.index = 0;
+        }
+        return engine.buffer[engine.index++];
+    }
+
+    // Fill out[0..n) with the same values n calls to uniform() would give.
+    static void fill(engine_type & engine, Float * out, std::size_t n) {
+        while (n > 0 && engine.index < LANES) {
+            *out++ = engine.buffer[engine.index++];
+            n--;
+        }
+        std::size_t n_steps = n / LANES;
+        get_kernel<xoshiro_block_rng_::Kernel<Float>>()(engine.state, out,
+                n_steps);
+        out += n_steps * LANES;
+        n -= n_steps * LANES;
+        while (n > 0) {
+            *out++ = uniform(engine);
+            n--;
+        }
+    }
+
+};
+
+#endif // XOSHIRO_BLOCK_RNG_HPP
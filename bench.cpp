@@ -0,0 +1,333 @@
+// Benchmarks of the sampler hot path, stage by stage and end to end.
+//
+// Usage: bench [scale]
+// -- scale multiplies the work per measurement (default 1, about 0.1 s each)
+//
+// Prints one CSV row per measurement (with a header row), for tracking
+// regressions across compilers and flags:
+//     stage,float,n_bins,n_sum,deposit_all,items,seconds,ns_per_item,mitems_per_s
+// Stages (items in brackets):
+// -- rng          : fill_uniforms with XoshiroBlockRNG [uniforms]
+// -- plf_call     : PiecewiseLinearFunction::operator() [values]
+// -- plf_evaluate : PiecewiseLinearFunction::evaluate [values]
+// -- adaptive_evaluate: AdaptivePiecewiseLinearFunction::evaluate, refined
+//                   on the same function [values]
+// -- analytic_evaluate, polynomial_evaluate: the same kind of block
+//                   evaluation with a closed-form inverse CDF (the function
+//                   the table interpolates) and a degree-5 Polynomial
+//                   [values]
+// -- normalize    : clamp, normalize and nudge one tuple, as the sampler does
+//                   [tuples]
+// -- normalize_nextafter: the same with std::nextafter for the nudges, as
+//                   the sampler used to [tuples]
+// -- deposit      : BinnedPDF::deposit [values]
+// -- deposit_batch: BinnedPDF::deposit_batch [values]
+// -- generate     : ProbabilitySampler::generate on one thread [deposits]
+// -- generate_analytic, generate_polynomial: the same with the closed-form
+//                   and polynomial inverse CDFs [deposits]
+// Columns that do not apply to a stage are empty.  Each time is the best of
+// three runs.
+
+#include "AdaptivePiecewiseLinearFunction.hpp"
+#include "BinnedPDF.hpp"
+#include "InverseCDF.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "RNGPolicies.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr std::size_t BLOCK = 1 << 10;
+
+std::size_t scale = 1;
+
+// Keeps results alive so the measured work is not optimized away
+volatile double sink;
+
+// Makes the compiler assume p's memory is read and changed here, so work on
+// the same block is redone on every pass
+inline void clobber(void const * p) {
+    asm volatile("" : : "r"(p) : "memory");
+}
+
+template <typename Float>
+char const * float_name() {
+    return sizeof(Float) == sizeof(float) ? "float" : "double";
+}
+
+std::string field(long const value) {
+    return value < 0 ? std::string() : std::to_string(value);
+}
+
+void report(char const * stage, char const * float_type, long const n_bins,
+        long const n_sum, long const deposit_all, std::size_t const items,
+        double const seconds) {
+    std::cout << stage << ',' << float_type << ',' << field(n_bins) << ','
+        << field(n_sum) << ',' << field(deposit_all) << ',' << items << ','
+        << seconds << ',' << seconds * 1e9 / double(items) << ','
+        << double(items) / seconds * 1e-6 << '\n';
+}
+
+// Best time of three runs of f
+template <typename F>
+double best_of_three(F && f) {
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0; r < 3; r++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        best = std::min(best, std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+template <typename Float, std::size_t N_BINS>
+PiecewiseLinearFunction<Float, N_BINS> make_function() {
+    std::array<Float, N_BINS-1> points;
+    for (std::size_t n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float(N_BINS);
+        points[n] = x * (Float{2} - x);
+    }
+    return PiecewiseLinearFunction<Float, N_BINS>(points);
+}
+
+// The function make_function tabulates
+struct Analytic {
+    template <typename Float>
+    constexpr Float operator()(Float const x) const {
+        return x * (Float{2} - x);
+    }
+};
+
+// 0.999 (6x^5 - 15x^4 + 10x^3), increasing from 0 to 0.999 on [0,1] (so
+// rounding cannot take it past one)
+template <typename Float>
+constexpr Polynomial<Float, 6> make_polynomial() {
+    return Polynomial<Float, 6>({0, 0, 0, Float(9.99), Float(-14.985),
+            Float(5.994)});
+}
+
+// Uniforms in [0,1) for the stages that take them as input
+template <typename Float>
+std::vector<Float> uniforms(std::size_t const n) {
+    using RNG = XoshiroBlockRNG<Float>;
+    auto engine = RNG::make_engine(1, 0);
+    std::vector<Float> u(n);
+    fill_uniforms<RNG>(engine, u.data(), n);
+    return u;
+}
+
+// ----------------------------------------------------------------------------
+// Stages
+
+template <typename Float>
+void bench_rng() {
+    using RNG = XoshiroBlockRNG<Float>;
+    std::size_t n = scale << 24;
+    std::vector<Float> out(BLOCK);
+    auto engine = RNG::make_engine(1, 0);
+    double t = best_of_three([&]() {
+        for (std::size_t i = 0; i < n; i += BLOCK) {
+            fill_uniforms<RNG>(engine, out.data(), BLOCK);
+            clobber(out.data());
+        }
+        sink = out[0];
+    });
+    report("rng", float_name<Float>(), -1, -1, -1, n, t);
+}
+
+template <typename Float, std::size_t N_BINS>
+void bench_plf() {
+    auto f = make_function<Float, N_BINS>();
+    std::size_t n = scale << 23;
+    auto in = uniforms<Float>(BLOCK);
+    std::vector<Float> out(BLOCK);
+    double t = best_of_three([&]() {
+        for (std::size_t i = 0; i < n; i += BLOCK) {
+            for (std::size_t j = 0; j < BLOCK; j++) {
+                out[j] = f(in[j]);
+            }
+            clobber(out.data());
+        }
+        sink = out[0];
+    });
+    report("plf_call", float_name<Float>(), N_BINS, -1, -1, n, t);
+    t = best_of_three([&]() {
+        for (std::size_t i = 0; i < n; i += BLOCK) {
+            f.evaluate(in.data(), out.data(), BLOCK);
+            clobber(out.data());
+        }
+        sink = out[0];
+    });
+    report("plf_evaluate", float_name<Float>(), N_BINS, -1, -1, n, t);
+    auto adaptive = AdaptivePiecewiseLinearFunction<Float, N_BINS>::refine(
+            Analytic{});
+    t = best_of_three([&]() {
+        for (std::size_t i = 0; i < n; i += BLOCK) {
+            adaptive.evaluate(in.data(), out.data(), BLOCK);
+            clobber(out.data());
+        }
+        sink = out[0];
+    });
+    report("adaptive_evaluate", float_name<Float>(), N_BINS, -1, -1, n, t);
+}
+
+template <typename Float, typename InverseCDF>
+void bench_closed_form(char const * stage, InverseCDF const & f) {
+    std::size_t n = scale << 23;
+    auto in = uniforms<Float>(BLOCK);
+    std::vector<Float> out(BLOCK);
+    double t = best_of_three([&]() {
+        for (std::size_t i = 0; i < n; i += BLOCK) {
+            inverse_cdfs_::evaluate(f, in.data(), out.data(), BLOCK);
+            clobber(out.data());
+        }
+        sink = out[0];
+    });
+    report(stage, float_name<Float>(), -1, -1, -1, n, t);
+}
+
+// Same arithmetic as ProbabilitySampler::normalize_block_ (with bits, the
+// same nudges too)
+template <typename Float, std::size_t N_SUM, bool bits = true>
+void bench_normalize() {
+    std::size_t n = scale << 22;
+    auto in = uniforms<Float>(BLOCK * N_SUM);
+    std::vector<Float> out(BLOCK * N_SUM);
+    auto up = [](Float const x) {
+        return bits ? probability_sampler_::toward_one(x)
+            : std::nextafter(x, Float{1});
+    };
+    auto down = [](Float const x) {
+        return bits ? probability_sampler_::toward_zero(x)
+            : std::nextafter(x, Float{0});
+    };
+    double t = best_of_three([&]() {
+        for (std::size_t i = 0; i < n; i += BLOCK) {
+            Float const * x = in.data();
+            Float * y = out.data();
+            for (std::size_t j = 0; j < BLOCK; j++, x += N_SUM, y += N_SUM) {
+                Float sum{0};
+                for (std::size_t k = 0; k < N_SUM; k++) {
+                    y[k] = std::max(up(x[k]),
+                            std::numeric_limits<Float>::min());
+                    sum += y[k];
+                }
+                Float denom = Float{1} / sum;
+                for (std::size_t k = 0; k < N_SUM; k++) {
+                    y[k] = down(y[k] * denom);
+                }
+            }
+            clobber(out.data());
+        }
+        sink = out[0];
+    });
+    report(bits ? "normalize" : "normalize_nextafter", float_name<Float>(),
+            -1, N_SUM, -1, n, t);
+}
+
+template <typename Float, std::size_t N_BINS>
+void bench_deposit() {
+    std::size_t n = scale << 23;
+    auto in = uniforms<Float>(BLOCK);
+    BinnedPDF<Float, std::uint64_t, N_BINS> pdf;
+    double t = best_of_three([&]() {
+        for (std::size_t i = 0; i < n; i += BLOCK) {
+            for (std::size_t j = 0; j < BLOCK; j++) {
+                pdf.deposit(in[j]);
+            }
+        }
+    });
+    sink = double(pdf.count());
+    report("deposit", float_name<Float>(), N_BINS, -1, -1, n, t);
+    t = best_of_three([&]() {
+        for (std::size_t i = 0; i < n; i += BLOCK) {
+            pdf.deposit_batch(in.data(), BLOCK);
+        }
+    });
+    sink = double(pdf.count());
+    report("deposit_batch", float_name<Float>(), N_BINS, -1, -1, n, t);
+}
+
+template <typename Float, std::size_t N_BINS, std::size_t N_SUM,
+         bool deposit_all,
+         typename InverseCDF = PiecewiseLinearFunction<Float, N_BINS>>
+void bench_generate(char const * stage = "generate",
+        InverseCDF const & f = make_function<Float, N_BINS>()) {
+    std::size_t n = scale << 22;
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+        XoshiroBlockRNG<Float>, std::uint64_t, ShardedHistogram, InverseCDF>
+            sampler(f);
+    sampler.set_seed(1);
+    sampler.set_threads(1);
+    sampler.set_stopping_rule(FixedCount(n));
+    double t = best_of_three([&]() {
+        sink = double(sampler.generate().count());
+    });
+    report(stage, float_name<Float>(), N_BINS, N_SUM, deposit_all, n, t);
+}
+
+// The closed-form inverse CDFs against the table, for every tuple size
+template <typename Float, std::size_t N_BINS, std::size_t N_SUM>
+void bench_generate_closed_form() {
+    bench_generate<Float, N_BINS, N_SUM, true>("generate_analytic",
+            Analytic{});
+    bench_generate<Float, N_BINS, N_SUM, true>("generate_polynomial",
+            make_polynomial<Float>());
+}
+
+// ----------------------------------------------------------------------------
+// Configurations
+
+template <typename Float, std::size_t N_BINS>
+void bench_bins() {
+    bench_plf<Float, N_BINS>();
+    bench_deposit<Float, N_BINS>();
+    bench_generate<Float, N_BINS, 1, true>();
+    bench_generate<Float, N_BINS, 2, true>();
+    bench_generate<Float, N_BINS, 2, false>();
+    bench_generate<Float, N_BINS, 4, true>();
+    bench_generate<Float, N_BINS, 4, false>();
+    bench_generate_closed_form<Float, N_BINS, 1>();
+    bench_generate_closed_form<Float, N_BINS, 2>();
+    bench_generate_closed_form<Float, N_BINS, 4>();
+}
+
+template <typename Float>
+void bench_float() {
+    bench_rng<Float>();
+    bench_normalize<Float, 1>();
+    bench_normalize<Float, 2>();
+    bench_normalize<Float, 4>();
+    bench_normalize<Float, 1, false>();
+    bench_normalize<Float, 2, false>();
+    bench_normalize<Float, 4, false>();
+    bench_closed_form<Float>("analytic_evaluate", Analytic{});
+    bench_closed_form<Float>("polynomial_evaluate", make_polynomial<Float>());
+    bench_bins<Float, 64>();
+    bench_bins<Float, 1024>();
+    bench_bins<Float, 65536>();
+}
+
+} // end anonymous namespace
+
+int main(int argc, char ** argv) {
+    if (argc > 1) {
+        scale = std::max(1L, std::atol(argv[1]));
+    }
+    std::cout << "stage,float,n_bins,n_sum,deposit_all,items,seconds,"
+        "ns_per_item,mitems_per_s\n";
+    bench_float<float>();
+    bench_float<double>();
+}
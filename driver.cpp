@@ -1,5 +1,6 @@
 #include "PiecewiseLinearFunction.hpp"
 #include "ProbabilitySampler.hpp"
+#include "XoshiroBlockRNG.hpp"
 
 #include <array>
 #include <fstream>
@@ -34,7 +35,9 @@ void do_stuff() {
 
     Function inverse_cdf(inverse_cdf_bins);
 
-    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS> sampler(inverse_cdf);
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+        XoshiroBlockRNG<Float>> sampler(inverse_cdf);
+    sampler.set_threads(0);
 
     auto pdf = sampler.generate();
     auto x = pdf.get_bin_centers();
@@ -50,7 +53,7 @@ void do_stuff() {
         fout << std::fixed << std::setw(8) << x[n];
         fout << "   ";
         fout << std::right << std::setw(9) << y[n];
-        fout << std::endl;
+        fout << '\n';
     }
 
 }
@@ -0,0 +1,27 @@
+#include "PDFCheckpoint.hpp"
+
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Usage: merge_checkpoints OUTPUT INPUT...
+// -- Sums checkpoints of disjoint tuple ranges of one run (e.g. written by
+//    separate processes with ProbabilitySampler::sample_range) into one
+//    checkpoint of their union (see PDFCheckpoint.hpp).
+int main(int argc, char ** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " OUTPUT INPUT..." << std::endl;
+        return 1;
+    }
+    std::vector<std::string> inputs(argv + 2, argv + argc);
+    try {
+        CheckpointInfo info = merge_checkpoints(inputs, argv[1]);
+        std::cout << argv[1] << ": tuples [" << info.first_tuple << ", "
+            << info.last_tuple << ") from " << inputs.size() << " files"
+            << std::endl;
+    } catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,77 @@
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "ShardRunner.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Usage:
+//     shards N_PROCESSES N_DEPOSITS SEED
+//         Runs the job across N_PROCESSES local processes and writes the PDF
+//         to stdout (in the format of driver's output files).
+//     shards --part P N_PARTS N_DEPOSITS SEED OUTPUT
+//         Runs part P of N_PARTS of the same job in this process and writes
+//         it to the checkpoint file OUTPUT, for merge_checkpoints.
+// The job is driver's: inverse CDF x (2 - x), N_BINS and N_SUM fixed at
+// compile time, deposit_all.
+int main(int argc, char ** argv) {
+    using Float = double;
+    constexpr int N_BINS{USER_N_BINS};
+    constexpr int N_SUM{USER_N_SUM};
+    using Function = PiecewiseLinearFunction<Float, N_BINS>;
+    using Sampler = ProbabilitySampler<true, Float, N_SUM, N_BINS,
+          XoshiroBlockRNG<Float>>;
+
+    bool part = argc > 1 && std::string(argv[1]) == "--part";
+    if ((part && argc != 7) || (!part && argc != 4)) {
+        std::cerr << "usage: " << argv[0] << " N_PROCESSES N_DEPOSITS SEED\n"
+            << "       " << argv[0]
+            << " --part P N_PARTS N_DEPOSITS SEED OUTPUT" << std::endl;
+        return 1;
+    }
+    auto arg = [&](int i) { return std::strtoull(argv[i], nullptr, 10); };
+
+    std::array<Float, N_BINS-1> points;
+    auto edges = Function::get_bin_edges();
+    for (int n = 0; n < N_BINS-1; n++) {
+        points[n] = edges[n] * (Float{2} - edges[n]);
+    }
+    Function inverse_cdf(points);
+    Sampler sampler(inverse_cdf);
+
+    try {
+        if (part) {
+            sampler.set_seed(arg(5));
+            ShardRunner<Sampler>::run_part(sampler, arg(4), arg(2), arg(3),
+                    argv[6]);
+            return 0;
+        }
+        sampler.set_seed(arg(3));
+        ShardRunner<Sampler> runner(arg(1));
+        auto start = std::chrono::steady_clock::now();
+        auto pdf = runner.run(sampler, arg(2));
+        double seconds = std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - start).count();
+        std::cerr << "count=" << pdf.count() << " seconds=" << seconds
+            << std::endl;
+        auto x = pdf.get_bin_centers();
+        auto y = pdf.get_pdf();
+        for (int n = 0; n < N_BINS; n++) {
+            std::cout << std::right << std::setw(6) << n;
+            std::cout << "   ";
+            std::cout << std::fixed << std::setw(8) << x[n];
+            std::cout << "   ";
+            std::cout << std::right << std::setw(9) << y[n];
+            std::cout << '\n';
+        }
+    } catch (std::exception const & e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
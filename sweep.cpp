@@ -0,0 +1,47 @@
+#include "SweepScheduler.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+// Usage: sweep JOB_FILE [N_THREADS]
+// -- See SweepScheduler.hpp for the job list format.
+// -- Each job's PDF is written to stdout as soon as it finishes: a header
+//    line, then one line per bin in the format of driver's output files.
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " JOB_FILE [N_THREADS]" << std::endl;
+        return 1;
+    }
+    std::ifstream fin(argv[1]);
+    if (!fin) {
+        std::cerr << "cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+    std::size_t n_threads = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0;
+
+    using Scheduler = SweepScheduler<double>;
+    auto jobs = Scheduler::read_jobs(fin);
+    Scheduler scheduler(n_threads);
+    scheduler.run(jobs, [](Scheduler::Result const & result) {
+        auto const & job = *result.job;
+        auto x = result.pdf.get_bin_centers();
+        auto y = result.pdf.get_pdf();
+        std::cout << "# " << job.name
+            << " deposit_all=" << job.deposit_all
+            << " n_sum=" << job.n_sum
+            << " n_bins=" << job.n_bins
+            << " count=" << result.pdf.count()
+            << " seconds=" << result.seconds << '\n';
+        for (std::size_t n = 0; n < x.size(); n++) {
+            std::cout << std::right << std::setw(6) << n;
+            std::cout << "   ";
+            std::cout << std::fixed << std::setw(8) << x[n];
+            std::cout << "   ";
+            std::cout << std::right << std::setw(9) << y[n];
+            std::cout << std::defaultfloat << '\n';
+        }
+        std::cout << std::flush;
+    });
+}
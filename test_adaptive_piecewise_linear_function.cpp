@@ -0,0 +1,167 @@
+#include "AdaptivePiecewiseLinearFunction.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+// Bends sharply only near one: most of the error of uniform bins is there
+template <typename Float>
+Float steep(Float const x) {
+    Float x2 = x * x;
+    Float x4 = x2 * x2;
+    return x4 * x4;
+}
+
+// Uneven edges (squares of uniform ones) with uniform values on them, so
+// every bin has its own slope
+template <typename Float, int N_BINS>
+AdaptivePiecewiseLinearFunction<Float, N_BINS> uneven() {
+    std::array<Float, N_BINS-1> edges;
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        edges[n] = x * x;
+        points[n] = x;
+    }
+    return AdaptivePiecewiseLinearFunction<Float, N_BINS>(edges, points);
+}
+
+template <typename Float, int N_BINS>
+void test_lookup() {
+    std::cout << "block lookup " << N_BINS << " ------------------------"
+        << std::endl;
+    auto func = uneven<Float, N_BINS>();
+    auto const & edges = func.get_bin_edges();
+    auto const & knots = func.get_knots();
+
+    // Includes bin edges, points just below them and an odd-sized tail.
+    std::vector<Float> in;
+    for (int n = 0; n < N_BINS; n++) {
+        in.push_back(edges[n]);
+        in.push_back(edges[n] + Float{0.37} * (edges[n+1] - edges[n]));
+        in.push_back(std::nextafter(edges[n+1], Float{0}));
+    }
+    in.push_back(std::nextafter(Float{1}, Float{0}));
+
+    // Against interpolation in the bin found by a linear scan (a wrong bin
+    // would extrapolate another bin's line)
+    bool matches = true;
+    for (auto x : in) {
+        std::size_t b = 0;
+        while (b + 1 < N_BINS && edges[b+1] <= x) {
+            b++;
+        }
+        Float w = (x - edges[b]) / (edges[b+1] - edges[b]);
+        Float expected = knots[b] + w * (knots[b+1] - knots[b]);
+        matches = matches && std::abs(func(x) - expected)
+            <= Float{16} * std::numeric_limits<Float>::epsilon();
+    }
+    CHECK(matches, "values match a linear scan of the bins");
+
+    std::vector<Float> out(in.size());
+    func.evaluate(in.data(), out.data(), in.size());
+    bool same = true;
+    for (std::size_t i = 0; i < in.size(); i++) {
+        same = same && (out[i] == func(in[i]));
+    }
+    CHECK(same, "evaluate == operator()");
+}
+
+// Refined bins fit a function that bends in one place far better than as
+// many uniform bins.  For x^8 the best placement is as good as four times
+// the uniform bins: the error goes as (integral of |f''|^(1/2))^2 / N^2
+// against max |f''| / N^2, a ratio of 16.
+template <typename Float>
+void test_refine() {
+    std::cout << "block refine ------------------------" << std::endl;
+    constexpr int N_BINS = 64;
+    auto f = [](Float x) { return steep(x); };
+    auto refined = AdaptivePiecewiseLinearFunction<Float, N_BINS>::refine(f);
+
+    auto uniform_error = [&](auto const & func) {
+        Float error{0};
+        for (int n = 0; n < (1 << 16); n++) {
+            Float x = (Float(n) + Float{0.5}) / Float(1 << 16);
+            error = std::max(error, Float(std::abs(func(x) - f(x))));
+        }
+        return error;
+    };
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        points[n] = f(Float(n+1) / Float{N_BINS});
+    }
+    PiecewiseLinearFunction<Float, N_BINS> uniform(points);
+    std::array<Float, 4*N_BINS-1> fine_points;
+    for (int n = 0; n < 4*N_BINS-1; n++) {
+        fine_points[n] = f(Float(n+1) / Float{4*N_BINS});
+    }
+    PiecewiseLinearFunction<Float, 4*N_BINS> fine(fine_points);
+
+    Float error = refined.max_error(f);
+    std::cout << "      : max error " << error << " refined, "
+        << uniform_error(uniform) << " uniform, " << uniform_error(fine)
+        << " uniform with 4x the bins" << std::endl;
+    CHECK((error < Float{0.5} * uniform_error(uniform)),
+            "refined beats uniform");
+    CHECK((error < Float{1.1} * uniform_error(fine)),
+            "refined as good as 4x the uniform bins");
+
+    // Bins are narrowest where f bends
+    auto const & edges = refined.get_bin_edges();
+    CHECK((edges[N_BINS] - edges[N_BINS-1] < edges[1] - edges[0]),
+            "narrow bins near the bend");
+
+    // Re-binning a fine table (only called inside (0,1))
+    auto rebinned = AdaptivePiecewiseLinearFunction<Float, N_BINS>::refine(fine);
+    CHECK((rebinned.max_error(f) < Float{0.5} * uniform_error(uniform)),
+            "re-binned table");
+}
+
+// Used as a sampler's inverse CDF
+void test_sampler() {
+    std::cout << "block sampler ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 64;
+    std::array<Float, 7> edges;
+    for (int n = 0; n < 7; n++) {
+        Float x = Float(n+1) / Float{8};
+        edges[n] = x * x;
+    }
+    AdaptivePiecewiseLinearFunction<Float, 8> identity(edges, edges);
+    auto exact = [](Float const x) { return x; };
+    ProbabilitySampler<true, Float, 2, N_BINS, XoshiroBlockRNG<Float>,
+        std::uint64_t, ShardedHistogram,
+        AdaptivePiecewiseLinearFunction<Float, 8>> sampler(identity);
+    ProbabilitySampler<true, Float, 2, N_BINS, XoshiroBlockRNG<Float>,
+        std::uint64_t, ShardedHistogram, decltype(exact)> reference(exact);
+    sampler.set_seed(11);
+    reference.set_seed(11);
+    auto pdf = sampler.generate();
+    auto expected = reference.generate();
+    std::uint64_t moved = 0;
+    for (int b = 0; b < N_BINS; b++) {
+        moved += std::max(pdf.get_bin(b), expected.get_bin(b))
+            - std::min(pdf.get_bin(b), expected.get_bin(b));
+    }
+    CHECK((pdf.count() == expected.count() && moved * 100000 < pdf.count()),
+            "same PDF as the exact identity");
+}
+
+int main() {
+    test_lookup<float, 1>();
+    test_lookup<double, 2>();
+    test_lookup<double, 8>();
+    test_lookup<float, 1024>();
+    test_lookup<double, 1024>();
+    test_refine<float>();
+    test_refine<double>();
+    test_sampler();
+}
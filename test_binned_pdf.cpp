@@ -1,8 +1,112 @@
 #include "BinnedPDF.hpp"
+#include "DynamicBinnedPDF.hpp"
 
 #include "check_macro.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+// deposit_batch gives the same counts as deposit, for small and large
+// (compact counters, partitioned) histograms
+template <typename PDF>
+void test_batch(PDF & scalar, PDF & batch) {
+    std::mt19937_64 gen(7);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    // Enough deposits that some compact counters wrap
+    std::vector<double> x(1 << 12);
+    for (int b = 0; b < 200; b++) {
+        for (auto & v : x) {
+            // Crowd half the values into a few bins
+            v = (b % 2 == 0) ? dist(gen) : 0.25 + 1e-7 * dist(gen);
+            scalar.deposit(v);
+        }
+        batch.deposit_batch(x.data(), x.size());
+    }
+    CHECK((batch.count() == scalar.count()), "batch count == scalar count");
+    CHECK((batch.get_all_bins() == scalar.get_all_bins()),
+            "batch bins == scalar bins");
+    // Reading flushes the compact counters; keep depositing after that
+    batch.deposit_batch(x.data(), x.size());
+    for (auto & v : x) {
+        scalar.deposit(v);
+    }
+    CHECK((batch.get_all_bins() == scalar.get_all_bins()),
+            "batch bins == scalar bins after a flush");
+    // Merge a PDF with pending compact counts
+    batch.deposit_batch(x.data(), x.size());
+    for (auto & v : x) {
+        scalar.deposit(v);
+    }
+    auto sum = std::make_unique<PDF>(scalar);
+    sum->clear();
+    *sum += batch;
+    CHECK((sum->get_all_bins() == scalar.get_all_bins()), "sum bins == scalar bins");
+    batch.clear();
+    batch.deposit_batch(x.data(), 1);
+    CHECK((batch.count() == 1), "count == 1 after clear");
+}
+
+// The running statistics match a pass over the bins
+template <typename PDF>
+bool statistics_match(PDF const & pdf) {
+    auto const & bins = pdf.get_all_bins();
+    double n_bins = double(bins.size());
+    double expected = double(pdf.count()) / n_bins;
+    double sum_sq{0};
+    double chi_sq{0};
+    for (auto const & c : bins) {
+        sum_sq += double(c) * double(c);
+        chi_sq += (double(c) - expected) * (double(c) - expected) / expected;
+    }
+    auto min = *std::min_element(bins.begin(), bins.end());
+    auto max = *std::max_element(bins.begin(), bins.end());
+    double max_dev = std::max(double(max) - expected, expected - double(min))
+        / expected;
+    return pdf.min_count() == min && pdf.max_count() == max
+        && double(pdf.sum_of_squares()) == sum_sq
+        && std::abs(double(pdf.chi_square()) - chi_sq) <= 1e-9 * (1.0 + chi_sq)
+        && std::abs(double(pdf.rms_deviation())
+                - std::sqrt(chi_sq / double(pdf.count()))) <= 1e-9
+        && std::abs(double(pdf.max_deviation()) - max_dev) <= 1e-12 * max_dev;
+}
+
+template <typename PDF>
+void test_statistics(PDF & pdf, PDF & other) {
+    std::mt19937_64 gen(11);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    std::vector<double> x(1 << 12);
+    // Skewed, so min and max move
+    for (int b = 0; b < 50; b++) {
+        for (auto & v : x) {
+            v = dist(gen);
+            v = v * v;
+        }
+        pdf.deposit_batch(x.data(), x.size());
+        pdf.deposit(x[0]);
+        other.deposit(dist(gen));
+    }
+    CHECK(statistics_match(pdf), "statistics after deposits");
+    pdf.add_to_bin(0, 5);
+    CHECK(statistics_match(pdf), "statistics after add_to_bin");
+    pdf += other;
+    CHECK(statistics_match(pdf), "statistics after merge");
+    pdf.deposit_batch_atomic(x.data(), x.size());
+    CHECK(statistics_match(pdf), "statistics after atomic deposits");
+    // Uniform deposits raise the minimum many times
+    for (int k = 0; k < 100; k++) {
+        for (std::size_t n = 0; n < pdf.get_all_bins().size(); n++) {
+            pdf.deposit((double(n) + 0.5) / double(pdf.get_all_bins().size()));
+        }
+        pdf.min_count();
+    }
+    CHECK(statistics_match(pdf), "statistics after uniform deposits");
+    pdf.clear();
+    CHECK((pdf.chi_square() == 0 && pdf.max_count() == 0), "statistics after clear");
+}
 
 int main() {
     using Float = double;
@@ -33,9 +137,59 @@ int main() {
             pdf.deposit(x);
         }
     }
-    CHECK(pdf.count() == N_BINS * (N_BINS - 1) / 2, "count == N(N-1)/2");
+    CHECK((pdf.count() == N_BINS * (N_BINS - 1) / 2), "count == N(N-1)/2");
+
+    for (int n = 0; n < N_BINS; n++) {
+        CHECK((pdf.get_bin(n) == n), "bin == n");
+    }
 
+    std::cout << "block 3 ------------------------" << std::endl;
+    BinnedPDF<Float, Integer, N_BINS> other;
+    for (int n = 0; n < N_BINS; n++) {
+        Float x = (Float(n) + Float{0.5}) / Float{N_BINS};
+        other.deposit(x);
+    }
+    pdf += other;
+    CHECK((pdf.count() == N_BINS * (N_BINS + 1) / 2), "count == N(N+1)/2");
     for (int n = 0; n < N_BINS; n++) {
-        CHECK(pdf.get_bin(n) == n, "bin == n");
+        CHECK((pdf.get_bin(n) == n + 1), "bin == n + 1");
+    }
+
+    std::cout << "block 4 ------------------------" << std::endl;
+    {
+        // Too big for the stack
+        using Small = BinnedPDF<Float, Integer, 1024>;
+        using Large = BinnedPDF<Float, Integer, (1 << 18)>;
+        auto small_scalar = std::make_unique<Small>();
+        auto small_batch = std::make_unique<Small>();
+        test_batch(*small_scalar, *small_batch);
+        auto large_scalar = std::make_unique<Large>();
+        auto large_batch = std::make_unique<Large>();
+        test_batch(*large_scalar, *large_batch);
+    }
+
+    std::cout << "block 5 ------------------------" << std::endl;
+    {
+        using Dynamic = DynamicBinnedPDF<Float, Integer>;
+        for (std::size_t n_bins : {std::size_t(1000), std::size_t(1) << 17,
+                    std::size_t(3) << 20}) {
+            Dynamic scalar(n_bins);
+            Dynamic batch(n_bins);
+            test_batch(scalar, batch);
+        }
+    }
+
+    std::cout << "block 6 ------------------------" << std::endl;
+    {
+        BinnedPDF<Float, Integer, 64> small;
+        BinnedPDF<Float, Integer, 64> small_other;
+        test_statistics(small, small_other);
+        using Large = BinnedPDF<Float, Integer, (1 << 17)>;
+        auto large = std::make_unique<Large>();
+        auto large_other = std::make_unique<Large>();
+        test_statistics(*large, *large_other);
+        DynamicBinnedPDF<Float, std::uint64_t> dynamic(1000);
+        DynamicBinnedPDF<Float, std::uint64_t> dynamic_other(1000);
+        test_statistics(dynamic, dynamic_other);
     }
 }
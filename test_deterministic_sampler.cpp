@@ -0,0 +1,69 @@
+#include "DeterministicSampler.hpp"
+#include "ProbabilitySampler.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <cmath>
+#include <iostream>
+
+template <int N_SUM>
+void test() {
+    std::cout << "block N_SUM=" << N_SUM << " ------------------------"
+        << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 32;
+
+    // The driver's inverse CDF, with a flat segment to exercise the atoms
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = Float{0.5} + (x < Float{0.5} ? 1 : -1) *
+            (Float{2} * x * (Float{1} - x) - Float{0.5});
+    }
+    points[20] = points[19];
+    PiecewiseLinearFunction<Float, N_BINS> inverse_cdf(points);
+
+    DeterministicSampler<true, Float, N_SUM, N_BINS> exact(inverse_cdf);
+    auto exact_pdf = exact.generate();
+    CHECK((std::abs(exact_pdf.count() - 1) < 1e-9), "masses sum to one");
+
+    // Agrees with Monte Carlo within the sampling noise
+    ProbabilitySampler<true, Float, N_SUM, N_BINS, XoshiroBlockRNG<Float>>
+        sampler(inverse_cdf);
+    sampler.set_seed(31);
+    sampler.set_stopping_rule(FixedCount(4000000));
+    auto sampled = sampler.generate();
+    auto p_exact = exact_pdf.get_pdf();
+    auto p_sampled = sampled.get_pdf();
+    double max_z{0};
+    for (int n = 0; n < N_BINS; n++) {
+        double sigma = std::sqrt(p_exact[n] / double(sampled.count()));
+        max_z = std::max(max_z, std::abs(p_sampled[n] - p_exact[n]) / sigma);
+    }
+    CHECK((max_z < 5), "within 5 sigma of Monte Carlo");
+}
+
+int main() {
+    std::cout << "block identity ------------------------" << std::endl;
+    {
+        using Float = double;
+        constexpr int N_BINS = 8;
+        std::array<Float, N_BINS-1> points;
+        for (int n = 0; n < N_BINS-1; n++) {
+            points[n] = Float(n+1) / Float{N_BINS};
+        }
+        PiecewiseLinearFunction<Float, N_BINS> inverse_cdf(points);
+        DeterministicSampler<false, Float, 1, N_BINS> exact(inverse_cdf);
+        auto p = exact.generate().get_pdf();
+        bool uniform = true;
+        for (auto const & x : p) {
+            uniform = uniform && std::abs(x - Float{1} / N_BINS) < 1e-12;
+        }
+        CHECK(uniform, "identity gives a uniform PDF");
+    }
+    test<1>();
+    test<2>();
+    test<3>();
+    test<4>();
+}
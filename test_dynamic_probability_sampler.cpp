@@ -0,0 +1,101 @@
+#include "DynamicBinnedPDF.hpp"
+#include "DynamicPiecewiseLinearFunction.hpp"
+#include "DynamicProbabilitySampler.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <vector>
+
+template <typename Float, std::size_t N_PTS>
+auto make_points() {
+    std::array<Float, N_PTS> points;
+    for (std::size_t n = 0; n < N_PTS; n++) {
+        Float x = Float(n+1) / Float(N_PTS+1);
+        points[n] = x * (Float{2} - x);
+    }
+    return points;
+}
+
+// The run-time function matches the fixed-size one, at exact, half and other
+// resolutions
+template <std::size_t N_BINS, std::size_t N_PTS>
+void test_function() {
+    std::cout << "block function N_BINS=" << N_BINS << " N_PTS=" << N_PTS
+        << " ------------------------" << std::endl;
+    using Float = double;
+    auto points = make_points<Float, N_PTS>();
+    PiecewiseLinearFunction<Float, N_BINS> fixed(points);
+    DynamicPiecewiseLinearFunction<Float> dynamic(N_BINS,
+            std::vector<Float>(points.begin(), points.end()));
+    CHECK((dynamic.n_bins() == N_BINS), "n_bins");
+
+    std::vector<Float> in(4096);
+    for (std::size_t i = 0; i < in.size(); i++) {
+        in[i] = Float(i) / Float(in.size());
+    }
+    std::vector<Float> out(in.size());
+    dynamic.evaluate(in.data(), out.data(), in.size());
+    bool same = true;
+    for (std::size_t i = 0; i < in.size(); i++) {
+        same = same && out[i] == fixed(in[i]) && out[i] == dynamic(in[i]);
+    }
+    CHECK(same, "values match PiecewiseLinearFunction");
+}
+
+// The run-time sampler gives the same bins as ProbabilitySampler, whether it
+// runs a compile-time kernel from the table or the generic path
+template <bool deposit_all, std::size_t N_SUM, std::size_t N_BINS, typename RNG>
+void test_sampler(bool const specialized) {
+    std::cout << "block sampler deposit_all=" << deposit_all
+        << " N_SUM=" << N_SUM << " N_BINS=" << N_BINS
+        << " ------------------------" << std::endl;
+    using Float = double;
+    auto points = make_points<Float, N_BINS-1>();
+
+    PiecewiseLinearFunction<Float, N_BINS> fixed_cdf(points);
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG> fixed(fixed_cdf);
+    fixed.set_seed(77);
+    fixed.set_stream(3);
+    auto reference = fixed.generate();
+
+    DynamicPiecewiseLinearFunction<Float> inverse_cdf(
+            std::vector<Float>(points.begin(), points.end()));
+    // A small table keeps the build quick
+    DynamicProbabilitySampler<Float, RNG, SizeList<2, 3>, SizeList<16, 64>>
+        dynamic(deposit_all, N_SUM, inverse_cdf);
+    CHECK((dynamic.specialized() == specialized), "dispatch");
+    dynamic.set_seed(77);
+    dynamic.set_stream(3);
+    dynamic.set_threads(3);
+    typename decltype(dynamic)::PDF pdf;
+    dynamic.generate(pdf);
+    CHECK((pdf.n_bins() == N_BINS), "n_bins");
+    CHECK((pdf.count() == reference.count()), "count matches");
+    auto const & bins = pdf.get_all_bins();
+    auto const & ref_bins = reference.get_all_bins();
+    CHECK(std::equal(bins.begin(), bins.end(), ref_bins.begin()),
+            "bins match ProbabilitySampler");
+
+    // Stopping rules see the run-time PDF
+    dynamic.set_stopping_rule(RelativeError(1e-6, 50000, 200000));
+    dynamic.generate(pdf);
+    CHECK((pdf.count() >= 200000 && pdf.count() < 200000 + int(N_SUM)),
+            "stopping rule");
+}
+
+int main() {
+    test_function<16, 15>();
+    test_function<16, 7>();
+    test_function<24, 9>();
+    test_sampler<true, 2, 64, MersenneTwisterRNG<double>>(true);
+    test_sampler<false, 3, 16, PhiloxRNG<double>>(true);
+    test_sampler<true, 3, 24, PhiloxRNG<double>>(false);
+    test_sampler<false, 5, 40, XoshiroBlockRNG<double>>(false);
+    test_sampler<true, 2, 16, XoshiroBlockRNG<double>>(true);
+}
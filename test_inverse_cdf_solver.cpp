@@ -0,0 +1,52 @@
+#include "InverseCDFSolver.hpp"
+
+#include "check_macro.hpp"
+
+#include <iostream>
+
+template <int N_SUM>
+void test(std::size_t const max_iterations, bool const common = false) {
+    std::cout << "block N_SUM=" << N_SUM << " common=" << common
+        << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 32;
+
+    // Skewed initial guess
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * x;
+    }
+
+    using Solver = InverseCDFSolver<true, Float, N_SUM, N_BINS>;
+    Solver solver(points);
+    solver.set_seed(2024);
+    solver.set_max_iterations(max_iterations);
+    if (common) {
+        solver.set_common_random_numbers(1 << 20);
+    }
+    auto report = solver.solve();
+
+    CHECK((report.iterations <= max_iterations), "iterations <= max");
+    CHECK((report.history.size() == report.iterations), "history size");
+    CHECK((report.rms_error < report.history.front()), "error decreased");
+
+    bool monotone = report.points.front() >= 0 && report.points.back() <= 1;
+    for (int n = 0; n < N_BINS-2; n++) {
+        monotone = monotone && report.points[n] <= report.points[n+1];
+    }
+    CHECK(monotone, "points are a valid inverse CDF");
+
+    if constexpr (N_SUM == 1) {
+        // One undamped step is exact up to sampling noise
+        CHECK(report.converged, "converged");
+        CHECK((report.iterations <= 3), "converged in a few iterations");
+    }
+}
+
+int main() {
+    test<1>(10);
+    test<2>(10);
+    test<1>(10, true);
+    test<2>(10, true);
+}
@@ -0,0 +1,92 @@
+#include "InverseCDFSolver.hpp"
+#include "MultigridSolver.hpp"
+
+#include "check_macro.hpp"
+
+#include <iostream>
+
+template <int N_SUM>
+void test(bool const common = false) {
+    std::cout << "block N_SUM=" << N_SUM << " common=" << common
+        << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 256;
+    constexpr int N_COARSE = 16;
+    constexpr std::uint64_t COARSE_DEPOSITS = 1 << 16;
+
+    // Skewed initial guess
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * x;
+    }
+
+    MultigridSolver<true, Float, N_SUM, N_BINS, N_COARSE> multigrid(points);
+    multigrid.set_seed(2024);
+    multigrid.set_deposits(COARSE_DEPOSITS);
+    multigrid.set_max_iterations(30);
+    multigrid.set_common_random_numbers(common);
+    auto report = multigrid.solve();
+
+    CHECK((report.levels.size() == 5), "one level per doubling");
+    bool doubling = report.levels.front().n_bins == N_COARSE;
+    std::uint64_t deposits = 0;
+    for (std::size_t l = 0; l < report.levels.size(); l++) {
+        auto const & level = report.levels[l];
+        std::cout << "      : " << level.n_bins << " bins: "
+            << level.iterations << " iterations, rms error "
+            << level.rms_error << ", " << level.deposits << " deposits"
+            << std::endl;
+        if (l > 0) {
+            doubling = doubling
+                && level.n_bins == 2 * report.levels[l-1].n_bins;
+        }
+        deposits += level.deposits;
+    }
+    CHECK(doubling, "bins double per level");
+    CHECK((deposits == report.deposits), "deposits add up");
+
+    bool monotone = report.points.front() >= 0 && report.points.back() <= 1;
+    for (int n = 0; n < N_BINS-2; n++) {
+        monotone = monotone && report.points[n] <= report.points[n+1];
+    }
+    CHECK(monotone, "points are a valid inverse CDF");
+
+    // The same solve at full resolution, with the finest level's deposits
+    // per iteration
+    InverseCDFSolver<true, Float, N_SUM, N_BINS> direct(points);
+    direct.set_seed(2024);
+    direct.set_max_iterations(30);
+    direct.sampler().set_stopping_rule(FixedCount(COARSE_DEPOSITS * 16));
+    if (common) {
+        direct.set_common_random_numbers(COARSE_DEPOSITS * 16);
+    }
+    auto direct_report = direct.solve();
+    std::uint64_t direct_deposits = direct_report.iterations
+        * COARSE_DEPOSITS * 16;
+    std::cout << "      : direct: " << direct_report.iterations
+        << " iterations, rms error " << direct_report.rms_error << ", "
+        << direct_deposits << " deposits" << std::endl;
+
+    // With N_SUM = 1 one direct step is already exact, so a warm start can
+    // only break even; with N_SUM = 2 the direct solve spends its iterations
+    // at full resolution.
+    auto const & finest = report.levels.back();
+    if constexpr (N_SUM == 1) {
+        CHECK(finest.converged, "converged");
+        CHECK((finest.iterations == 1), "finest level starts converged");
+        CHECK((report.deposits <= direct_deposits),
+                "no more deposits than the direct solve");
+    } else {
+        CHECK((finest.rms_error <= 1.25 * direct_report.rms_error),
+                "about as accurate as the direct solve");
+        CHECK((2 * report.deposits < direct_deposits),
+                "under half the deposits of the direct solve");
+    }
+}
+
+int main() {
+    test<1>();
+    test<2>();
+    test<2>(true);
+}
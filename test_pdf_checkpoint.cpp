@@ -0,0 +1,198 @@
+#include "DynamicBinnedPDF.hpp"
+#include "PDFCheckpoint.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <array>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+constexpr int N_BINS = 64;
+constexpr int N_SUM = 3;
+
+using Float = double;
+using Function = PiecewiseLinearFunction<Float, N_BINS>;
+using Sampler = ProbabilitySampler<true, Float, N_SUM, N_BINS,
+      XoshiroBlockRNG<Float>>;
+
+Function make_function(Float const k) {
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * (Float{1} + k * (Float{1} - x));
+    }
+    return Function(points);
+}
+
+template <typename Call>
+bool throws(Call && call) {
+    try {
+        call();
+    } catch (std::runtime_error const &) {
+        return true;
+    }
+    return false;
+}
+
+int main() {
+    std::string const a = "test_checkpoint_a.bin";
+    std::string const b = "test_checkpoint_b.bin";
+    std::string const c = "test_checkpoint_c.bin";
+    std::string const merged = "test_checkpoint_merged.bin";
+
+    std::cout << "block 1 ------------------------" << std::endl;
+    // Round trip, fixed and dynamic
+    {
+        BinnedPDF<Float, std::uint64_t, N_BINS> pdf;
+        for (int n = 0; n < 1000; n++) {
+            pdf.deposit(Float((n * 37) % 1000) / Float{1000});
+        }
+        CheckpointInfo info{true, 3, 11, 2, 99, 5, 17, 0};
+        write_checkpoint(a, pdf, info);
+        BinnedPDF<Float, std::uint64_t, N_BINS> back;
+        auto read = read_checkpoint(a, back);
+        CHECK((back.get_all_bins() == pdf.get_all_bins()
+                    && back.count() == pdf.count()), "fixed round trip");
+        CHECK((read.deposit_all && read.n_sum == 3 && read.seed == 11
+                    && read.stream == 2 && read.inverse_cdf_hash == 99
+                    && read.first_tuple == 5 && read.last_tuple == 17),
+                "metadata round trip");
+        DynamicBinnedPDF<Float, std::uint64_t> dynamic(7);
+        read_checkpoint(a, dynamic);
+        CHECK((dynamic.n_bins() == N_BINS && dynamic.count() == pdf.count()
+                    && dynamic.max_count() == pdf.max_count()),
+                "dynamic PDF resized and filled");
+        BinnedPDF<Float, std::uint64_t, 2 * N_BINS> wrong;
+        CHECK(throws([&]() { read_checkpoint(a, wrong); }),
+                "wrong number of bins rejected");
+        std::FILE * f = std::fopen(b.c_str(), "wb");
+        std::fputs("not a checkpoint, but long enough to hold a header "
+                "if it were one ............................................",
+                f);
+        std::fclose(f);
+        CHECK(throws([&]() { MappedCheckpoint bad(b); }), "garbage rejected");
+    }
+
+    std::cout << "block 2 ------------------------" << std::endl;
+    // Periodic checkpoints do not change the result, and a killed run
+    // resumes where its last checkpoint left off
+    {
+        Function f = make_function(0.5);
+        Sampler sampler(f);
+        sampler.set_seed(21);
+        sampler.set_threads(2);
+        sampler.set_stopping_rule(FixedCount(600000));
+        auto full = sampler.generate();
+
+        std::remove(a.c_str());
+        sampler.set_checkpoint(a, 3 * Sampler::chunk_tuples() + 5);
+        auto checkpointed = sampler.generate();
+        CHECK((checkpointed.get_all_bins() == full.get_all_bins()),
+                "checkpointing leaves the result unchanged");
+
+        // "Killed" after 250000 deposits: its last checkpoint is all that
+        // survives
+        std::remove(a.c_str());
+        sampler.set_stopping_rule(FixedCount(250000));
+        sampler.generate();
+        MappedCheckpoint partial(a);
+        CHECK((partial.info().last_tuple == Sampler::tuples_for(250000)),
+                "checkpoint records the sample offset");
+        // A fresh sampler without a seed picks the run up from the file
+        Sampler resumed(f);
+        resumed.set_checkpoint(a, 3 * Sampler::chunk_tuples());
+        resumed.set_stopping_rule(FixedCount(600000));
+        auto rest = resumed.generate();
+        CHECK((rest.get_all_bins() == full.get_all_bins()
+                    && rest.count() == full.count()),
+                "resumed run == uninterrupted run");
+
+        // A different inverse CDF is refused
+        Sampler other(make_function(0.25));
+        other.set_checkpoint(a);
+        CHECK(throws([&]() { other.generate(); }),
+                "checkpoint of another function rejected");
+        // So is a different sampling mode
+        Sampler stratified(f);
+        stratified.set_sampling_mode(SamplingMode::stratified);
+        stratified.set_checkpoint(a);
+        CHECK(throws([&]() { stratified.generate(); }),
+                "checkpoint of another sampling mode rejected");
+        std::remove(a.c_str());
+
+        // A run on another stream resumes without set_stream, but not on a
+        // sampler set to a different stream
+        Sampler streamed(f);
+        streamed.set_seed(21);
+        streamed.set_stream(5);
+        streamed.set_stopping_rule(FixedCount(600000));
+        auto streamed_full = streamed.generate();
+        streamed.set_checkpoint(a);
+        streamed.set_stopping_rule(FixedCount(250000));
+        streamed.generate();
+        Sampler streamed_resumed(f);
+        streamed_resumed.set_checkpoint(a);
+        streamed_resumed.set_stopping_rule(FixedCount(600000));
+        Sampler other_stream(f);
+        other_stream.set_stream(6);
+        other_stream.set_checkpoint(a);
+        CHECK(throws([&]() { other_stream.generate(); }),
+                "checkpoint of another stream rejected");
+        auto streamed_rest = streamed_resumed.generate();
+        CHECK((streamed_rest.get_all_bins() == streamed_full.get_all_bins()
+                    && streamed_rest.count() == streamed_full.count()),
+                "resumed run on stream 5 == uninterrupted run");
+        std::remove(a.c_str());
+    }
+
+    std::cout << "block 3 ------------------------" << std::endl;
+    // Ranges sampled separately merge into the whole run
+    {
+        Function f = make_function(0.5);
+        Sampler sampler(f);
+        sampler.set_seed(33);
+        std::size_t n_tuples = Sampler::tuples_for(500000);
+        sampler.set_stopping_rule(FixedCount(500000));
+        auto full = sampler.generate();
+
+        std::vector<Float> buffer;
+        std::size_t cut1 = 2 * Sampler::chunk_tuples();
+        std::size_t cut2 = 5 * Sampler::chunk_tuples() + 123;
+        std::array<std::size_t, 4> cuts{0, cut1, cut2, n_tuples};
+        std::array<std::string, 3> files{a, b, c};
+        for (int i = 0; i < 3; i++) {
+            Sampler::PDF part;
+            sampler.sample_range(cuts[i], cuts[i+1], part, buffer);
+            write_checkpoint(files[i], part,
+                    sampler.checkpoint_info(cuts[i], cuts[i+1]));
+        }
+        auto info = merge_checkpoints({c, a, b}, merged);
+        Sampler::PDF sum;
+        read_checkpoint(merged, sum);
+        CHECK((info.first_tuple == 0 && info.last_tuple == n_tuples),
+                "merged range covers the run");
+        CHECK((sum.get_all_bins() == full.get_all_bins()
+                    && sum.count() == full.count()), "merged == whole run");
+        CHECK(throws([&]() { merge_checkpoints({a, c}, merged); }),
+                "gap rejected");
+        CHECK(throws([&]() { merge_checkpoints({a, b, b}, merged); }),
+                "overlap rejected");
+        // A resumed generate() continues a merged checkpoint
+        Sampler resumed(f);
+        resumed.set_checkpoint(merged);
+        resumed.set_stopping_rule(FixedCount(800000));
+        sampler.set_stopping_rule(FixedCount(800000));
+        CHECK((resumed.generate().get_all_bins()
+                    == sampler.generate().get_all_bins()),
+                "generate() continues a merged checkpoint");
+        for (auto const & file : {a, b, c, merged}) {
+            std::remove(file.c_str());
+        }
+    }
+}
@@ -2,7 +2,11 @@
 
 #include "check_macro.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <random>
+#include <vector>
 
 template <int N>
 void test() {
@@ -23,6 +27,98 @@ void test() {
     }
 }
 
+template <typename Float, int N_BINS>
+void test_batch() {
+    std::cout << "block batch " << N_BINS << " ------------------------"
+        << std::endl;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * x * (Float{3} - Float{2} * x);
+    }
+    PiecewiseLinearFunction<Float, N_BINS> func(points);
+
+    // Includes bin edges, points just below them and an odd-sized tail.
+    std::vector<Float> in;
+    for (int n = 0; n < N_BINS; n++) {
+        Float x = Float(n) / Float{N_BINS};
+        in.push_back(x);
+        in.push_back(x + Float{0.37} / Float{N_BINS});
+        in.push_back(std::nextafter(Float(n+1) / Float{N_BINS}, Float{0}));
+    }
+    in.push_back(std::nextafter(Float{1}, Float{0}));
+
+    std::vector<Float> out(in.size());
+    func.evaluate(in.data(), out.data(), in.size());
+    bool same = true;
+    for (std::size_t i = 0; i < in.size(); i++) {
+        same = same && (out[i] == func(in[i]));
+    }
+    CHECK(same, "evaluate == operator()");
+}
+
+// Every build of the batch kernels (see CPUDispatch.hpp) the CPU can run gives
+// the same results, for the fixed and the run-time number of bins.  Arbitrary
+// coefficients, so that a fused multiply-add would round differently.
+template <typename Float, int N_BINS>
+void test_targets() {
+    std::cout << "block targets " << N_BINS << " ------------------------"
+        << std::endl;
+    using Fixed = cpu_dispatch_::Targets<
+        piecewise_linear_function_::Evaluate<Float, N_BINS>>;
+    using Dynamic = cpu_dispatch_::Targets<
+        piecewise_linear_function_::EvaluateDynamic<Float>>;
+
+    std::mt19937_64 gen(N_BINS);
+    std::uniform_real_distribution<Float> coefficient(-2, 2);
+    std::uniform_real_distribution<Float> unit(0, 1);
+    std::vector<Float> slopes(N_BINS);
+    std::vector<Float> intercepts(N_BINS);
+    for (int n = 0; n < N_BINS; n++) {
+        slopes[n] = coefficient(gen);
+        intercepts[n] = coefficient(gen);
+    }
+    // (odd-sized, for the vector loops' tails)
+    std::vector<Float> in(4099);
+    for (auto & x : in) {
+        x = std::min(unit(gen), std::nextafter(Float{1}, Float{0}));
+    }
+    std::size_t const n = in.size();
+
+    std::vector<Float> expected(n);
+    std::vector<Float> fixed(n);
+    std::vector<Float> dynamic(n);
+    Fixed::generic(slopes.data(), intercepts.data(), in.data(),
+            expected.data(), n);
+    Dynamic::generic(slopes.data(), intercepts.data(), in.data(),
+            dynamic.data(), n, N_BINS);
+    CHECK((dynamic == expected), "generic: dynamic == fixed");
+#if CPU_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        Fixed::avx2(slopes.data(), intercepts.data(), in.data(),
+                fixed.data(), n);
+        Dynamic::avx2(slopes.data(), intercepts.data(), in.data(),
+                dynamic.data(), n, N_BINS);
+        CHECK((fixed == expected && dynamic == expected), "avx2 == generic");
+    } else {
+        std::cout << "      : (no AVX2)" << std::endl;
+    }
+    if (__builtin_cpu_supports("avx512f")
+            && __builtin_cpu_supports("avx512vl")) {
+        Fixed::avx512(slopes.data(), intercepts.data(), in.data(),
+                fixed.data(), n);
+        Dynamic::avx512(slopes.data(), intercepts.data(), in.data(),
+                dynamic.data(), n, N_BINS);
+        CHECK((fixed == expected && dynamic == expected),
+                "avx512 == generic");
+    } else {
+        std::cout << "      : (no AVX-512)" << std::endl;
+    }
+#endif
+}
+
 int main() {
     test<1>();
     test<2>();
@@ -33,4 +129,12 @@ int main() {
     test<7>();
     test<8>();
     test<9>();
+    test_batch<float, 8>();
+    test_batch<double, 8>();
+    test_batch<float, 1024>();
+    test_batch<double, 1024>();
+    test_targets<float, 64>();
+    test_targets<double, 64>();
+    test_targets<float, 1024>();
+    test_targets<double, 1024>();
 }
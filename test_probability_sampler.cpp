@@ -0,0 +1,565 @@
+#include "InverseCDF.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "ScriptedRNG.hpp"
+#include "SobolRNG.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Edge cases for the uniform draws
+struct EdgeCases {
+    static std::vector<double> const & values() {
+        static std::vector<double> v{
+            0.0, 0.0,
+            0.0, std::nextafter(1.0, 0.0),
+            std::nextafter(1.0, 0.0), std::nextafter(1.0, 0.0),
+            0.5, 0.25};
+        return v;
+    }
+};
+
+template <bool deposit_all, typename RNG>
+void test_thread_invariance() {
+    std::cout << "block deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 16;
+    constexpr int N_SUM = 3;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * (Float{2} - x);
+    }
+    PiecewiseLinearFunction<Float, N_BINS> inverse_cdf(points);
+
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG> sampler(inverse_cdf);
+    sampler.set_seed(12345);
+
+    sampler.set_threads(1);
+    auto serial = sampler.generate();
+    CHECK((serial.count() >= 1000000), "count >= N_ITER");
+
+    for (int n_threads : {2, 3, 8}) {
+        sampler.set_threads(n_threads);
+        auto parallel = sampler.generate();
+        CHECK((parallel.count() == serial.count()),
+                "count independent of threads");
+        CHECK((parallel.get_all_bins() == serial.get_all_bins()),
+                "bins independent of threads");
+    }
+}
+
+// Counter types and histogram layouts change the cost, not the result
+template <bool deposit_all>
+void test_counters_and_layouts() {
+    std::cout << "block counters and layouts deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Float = double;
+    using RNG = PhiloxRNG<Float>;
+    constexpr int N_BINS = 16;
+    constexpr int N_SUM = 3;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * (Float{2} - x);
+    }
+    PiecewiseLinearFunction<Float, N_BINS> inverse_cdf(points);
+
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG> sampler(inverse_cdf);
+    sampler.set_seed(12345);
+    auto serial = sampler.generate();
+
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG, int> small(inverse_cdf);
+    small.set_seed(12345);
+    auto small_pdf = small.generate();
+    bool same = small_pdf.count() == int(serial.count());
+    for (int n = 0; n < N_BINS; n++) {
+        same = same && small_pdf.get_bin(n) == int(serial.get_bin(n));
+    }
+    CHECK(same, "int counters == 64-bit counters");
+
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG, std::uint64_t,
+        AtomicHistogram> atomic(inverse_cdf);
+    atomic.set_seed(12345);
+    for (int n_threads : {1, 3, 8}) {
+        atomic.set_threads(n_threads);
+        auto shared = atomic.generate();
+        CHECK((shared.count() == serial.count()), "atomic count == serial count");
+        CHECK((shared.get_all_bins() == serial.get_all_bins()),
+                "atomic bins == serial bins");
+    }
+}
+
+template <bool deposit_all>
+void test_edge_cases() {
+    std::cout << "block edge cases deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 8;
+    constexpr int N_SUM = 2;
+
+    // Identity inverse CDF
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        points[n] = Float(n+1) / Float{N_BINS};
+    }
+    PiecewiseLinearFunction<Float, N_BINS> inverse_cdf(points);
+
+    // The sampler asserts that every deposit is in [0,1), so getting through
+    // generate() at all shows that the edge cases are handled.
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+        ScriptedRNG<Float, EdgeCases>> sampler(inverse_cdf);
+    auto pdf = sampler.generate();
+    CHECK((pdf.count() >= 1000000), "count >= N_ITER");
+
+    // Each cycle of the script deposits (0,0) -> 1/2, (0,1) -> 0 (and 1),
+    // (1,1) -> 1/2 and (1/2,1/4) -> 2/3 (and 1/3).
+    auto bins = pdf.get_all_bins();
+    if constexpr (deposit_all) {
+        CHECK((bins[3] == 4 * bins[0]), "bin(1/2-) == 4 bin(0)");
+        CHECK((bins[7] == bins[0]), "bin(1-) == bin(0)");
+        CHECK((bins[2] == bins[0]), "bin(1/3) == bin(0)");
+        CHECK((bins[5] == bins[0]), "bin(2/3) == bin(0)");
+    } else {
+        CHECK((bins[3] == 2 * bins[0]), "bin(1/2-) == 2 bin(0)");
+        CHECK((bins[5] == bins[0]), "bin(2/3) == bin(0)");
+        CHECK((bins[7] == 0), "bin(1-) == 0");
+    }
+}
+
+// The bit-pattern nudges of the sampler agree with std::nextafter over
+// [0,1] and just above it
+template <typename Float>
+void test_nudges() {
+    std::cout << "block nudges ------------------------" << std::endl;
+    std::vector<Float> in{Float{0}, std::numeric_limits<Float>::denorm_min(),
+        std::numeric_limits<Float>::min(), Float{0.25}, Float{0.5},
+        std::nextafter(Float{1}, Float{0}), Float{1},
+        std::nextafter(Float{1}, Float{2}), Float{2}};
+    for (int n = 1; n < 1000; n++) {
+        in.push_back(Float(n) / Float{1000});
+    }
+    bool up = true;
+    bool down = true;
+    for (auto x : in) {
+        up = up && probability_sampler_::toward_one(x)
+            == std::nextafter(x, Float{1});
+        down = down && probability_sampler_::toward_zero(x)
+            == std::nextafter(x, Float{0});
+    }
+    CHECK(up, "toward_one == nextafter(x, 1)");
+    CHECK(down, "toward_zero == nextafter(x, 0)");
+}
+
+template <typename RNG>
+void test_stopping_rules() {
+    std::cout << "block stopping rules ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 16;
+    constexpr int N_SUM = 2;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        points[n] = Float(n+1) / Float{N_BINS};
+    }
+    PiecewiseLinearFunction<Float, N_BINS> inverse_cdf(points);
+    using Sampler = ProbabilitySampler<true, Float, N_SUM, N_BINS, RNG>;
+    Sampler sampler(inverse_cdf);
+    sampler.set_seed(99);
+    auto reference = sampler.generate();
+
+    // Rounds that end partway through chunks give the same result
+    sampler.set_stopping_rule([](auto const & pdf) -> std::size_t {
+        return pdf.count() < 1000000 ? std::min<std::size_t>(
+                333331, 1000000 - pdf.count()) : 0;
+    });
+    sampler.set_threads(3);
+    auto rounds = sampler.generate();
+    CHECK((rounds.get_all_bins() == reference.get_all_bins()),
+            "rounds give the same bins");
+
+    // Relative error target
+    double target = 0.01;
+    sampler.set_stopping_rule(RelativeError(target, 50000));
+    auto pdf = sampler.generate();
+    auto const & bins = pdf.get_all_bins();
+    auto min_bin = *std::min_element(bins.begin(), bins.end());
+    CHECK((min_bin * target * target >= 1), "min bin meets error target");
+    CHECK((pdf.count() < 1000000), "stops before fixed count");
+
+    // Relative error cap
+    sampler.set_stopping_rule(RelativeError(1e-6, 50000, 200000));
+    CHECK((sampler.generate().count() == 200000), "stops at cap");
+
+    // The identity inverse CDF gives a far-from-uniform output for N_SUM = 2
+    DivergenceAbort<FixedCount> abort(FixedCount(1000000), 0.2, 100000, 50000);
+    sampler.set_stopping_rule(std::ref(abort));
+    CHECK((sampler.generate().count() == 100000), "divergence abort");
+    CHECK(abort.aborted(), "aborted() set");
+
+    DivergenceAbort<FixedCount> loose(FixedCount(300000), 10.0, 100000, 50000);
+    sampler.set_stopping_rule(std::ref(loose));
+    CHECK((sampler.generate().count() == 300000), "no divergence abort");
+    CHECK(!loose.aborted(), "aborted() not set");
+}
+
+// Replaying cached uniforms gives the same bins as drawing them
+template <typename RNG>
+void test_uniform_cache() {
+    std::cout << "block uniform cache ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 16;
+    constexpr int N_SUM = 3;
+
+    std::array<Float, N_BINS-1> points;
+    std::array<Float, N_BINS-1> other_points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * (Float{2} - x);
+        other_points[n] = x * x;
+    }
+    PiecewiseLinearFunction<Float, N_BINS> inverse_cdf(points);
+    PiecewiseLinearFunction<Float, N_BINS> other_cdf(other_points);
+    using Sampler = ProbabilitySampler<false, Float, N_SUM, N_BINS, RNG>;
+
+    Sampler plain(inverse_cdf);
+    plain.set_seed(99);
+    auto reference = plain.generate();
+    plain.set_inverse_cdf(other_cdf);
+    auto other_reference = plain.generate();
+
+    // Capacity below the run length and not a multiple of the chunk size,
+    // with rounds ending partway through chunks
+    auto cache = std::make_shared<typename Sampler::Cache>(50000);
+    Sampler sampler(inverse_cdf);
+    sampler.set_seed(99);
+    sampler.set_threads(3);
+    sampler.set_uniform_cache(cache);
+    sampler.set_stopping_rule([](auto const & pdf) -> std::size_t {
+        return pdf.count() < 1000000 ? std::min<std::size_t>(
+                333331, 1000000 - pdf.count()) : 0;
+    });
+    CHECK((sampler.generate().get_all_bins() == reference.get_all_bins()),
+            "recording run matches");
+    CHECK((cache->recorded() == 50000), "cache filled");
+
+    sampler.set_seed(7);
+    sampler.set_stopping_rule(FixedCount(1000000));
+    CHECK((sampler.generate().get_all_bins() == reference.get_all_bins()),
+            "replay ignores the new seed");
+    sampler.set_inverse_cdf(other_cdf);
+    CHECK((sampler.generate().get_all_bins() == other_reference.get_all_bins()),
+            "replay with a new inverse CDF");
+
+    // Memory-mapped cache holding the whole run
+    char const * path = "test_uniform_cache.bin";
+    {
+        Sampler mapped(inverse_cdf);
+        mapped.set_seed(99);
+        mapped.set_uniform_cache(
+                std::make_shared<typename Sampler::Cache>(path, 1000000));
+        CHECK((mapped.generate().get_all_bins() == reference.get_all_bins()),
+                "mapped recording run matches");
+        mapped.set_inverse_cdf(other_cdf);
+        CHECK((mapped.generate().get_all_bins() == other_reference.get_all_bins()),
+                "mapped replay matches");
+    }
+    std::remove(path);
+}
+
+// Randomized QMC gives smaller error bars than pseudo-random sampling
+template <bool deposit_all>
+void test_replicates() {
+    std::cout << "block replicates deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 16;
+    constexpr int N_SUM = 2;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * (Float{2} - x);
+    }
+    PiecewiseLinearFunction<Float, N_BINS> inverse_cdf(points);
+
+    auto mean_error = [&](auto sampler) {
+        sampler.set_seed(2024);
+        sampler.set_stopping_rule(FixedCount(1 << 16));
+        auto result = sampler.generate_replicates(8);
+        double sum{0};
+        for (auto const & e : result.std_error) {
+            sum += e;
+        }
+        CHECK((result.pdf.count() == 8 * (1 << 16)),
+                "replicates merged");
+        return sum / N_BINS;
+    };
+    double qmc = mean_error(ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+            SobolRNG<Float, N_SUM>>(inverse_cdf));
+    double mc = mean_error(ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+            PhiloxRNG<Float>>(inverse_cdf));
+    std::cout << "    std error: qmc " << qmc << ", mc " << mc << std::endl;
+    CHECK((qmc > 0), "qmc replicates differ");
+    CHECK((qmc < 0.5 * mc), "qmc error below mc error");
+}
+
+template <bool deposit_all>
+void test_gradient() {
+    std::cout << "block gradient deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 16;
+    constexpr int N_SUM = 2;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * x;
+    }
+    using Sampler = ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+          PhiloxRNG<Float>>;
+    Sampler sampler{PiecewiseLinearFunction<Float, N_BINS>(points)};
+    sampler.set_seed(7);
+    sampler.set_stopping_rule(FixedCount(200000));
+
+    auto result = sampler.generate_with_gradient();
+    auto pdf = sampler.generate();
+    CHECK((result.pdf.get_all_bins() == pdf.get_all_bins()),
+            "histogram matches generate()");
+
+    Float total{0};
+    for (auto const & p : result.smoothed) {
+        total += p;
+    }
+    CHECK((std::abs(total - 1) < 1e-12), "smoothed PDF sums to one");
+
+    // Central differences with the same random numbers
+    Float h = 1e-7;
+    bool match = true;
+    for (int k : {0, 3, 7, 14}) {
+        auto plus = points;
+        auto minus = points;
+        plus[k] += h;
+        minus[k] -= h;
+        sampler.set_inverse_cdf(PiecewiseLinearFunction<Float, N_BINS>(plus));
+        auto loss_plus = sampler.generate_with_gradient().loss;
+        sampler.set_inverse_cdf(PiecewiseLinearFunction<Float, N_BINS>(minus));
+        auto loss_minus = sampler.generate_with_gradient().loss;
+        Float fd = (loss_plus - loss_minus) / (2 * h);
+        match = match && std::abs(fd - result.gradient[k])
+            <= 1e-3 * std::abs(result.gradient[k]) + 1e-6;
+    }
+    CHECK(match, "gradient matches finite differences");
+}
+
+// Variance-reduction modes give the same results for any threads and rounds,
+// and the batch variance of independent tuples is the multinomial one
+template <bool deposit_all>
+void test_sampling_modes() {
+    std::cout << "block sampling modes deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 32;
+    constexpr int N_SUM = 2;
+    using Sampler = ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+          XoshiroBlockRNG<Float>>;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * (Float{2} - x);
+    }
+    Sampler sampler{PiecewiseLinearFunction<Float, N_BINS>(points)};
+    sampler.set_seed(77);
+    std::size_t n_deposits = 400000;
+    sampler.set_batch_variance(true);
+
+    // Rounds of an odd number of tuples start pieces inside antithetic pairs
+    std::size_t per_tuple = deposit_all ? N_SUM : 1;
+    auto odd_rounds = [&](typename Sampler::PDF const & pdf) -> std::size_t {
+        std::size_t count = pdf.count();
+        return count < n_deposits
+            ? std::min(1001 * per_tuple, n_deposits - count) : 0;
+    };
+
+    sampler.set_stopping_rule(FixedCount(n_deposits));
+    sampler.set_threads(1);
+    auto independent = sampler.generate();
+    double independent_variance = 0;
+    double multinomial = 0;
+    for (std::size_t n = 0; n < N_BINS; n++) {
+        independent_variance += independent.get_bin_variance(n);
+        Float c = Float(independent.get_bin(n));
+        multinomial += c * (Float{1} - c / Float(independent.count()));
+    }
+    CHECK((std::abs(independent_variance / multinomial - 1.0) < 0.2),
+            "independent: batch variance ~ multinomial");
+
+    for (auto mode : {SamplingMode::antithetic, SamplingMode::stratified,
+            SamplingMode::latin_hypercube}) {
+        sampler.set_sampling_mode(mode);
+        sampler.set_stopping_rule(FixedCount(n_deposits));
+        sampler.set_threads(1);
+        auto serial = sampler.generate();
+        sampler.set_threads(3);
+        auto parallel = sampler.generate();
+        sampler.set_stopping_rule(odd_rounds);
+        sampler.set_threads(2);
+        auto rounds = sampler.generate();
+        std::cout << "      mode " << int(mode) << ":" << std::endl;
+        CHECK((parallel.get_all_bins() == serial.get_all_bins()),
+                "bins independent of threads");
+        CHECK((rounds.get_all_bins() == serial.get_all_bins()),
+                "bins independent of rounds");
+        CHECK((serial.get_all_bins() != independent.get_all_bins()),
+                "bins differ from independent tuples");
+        double variance = 0;
+        for (std::size_t n = 0; n < N_BINS; n++) {
+            variance += serial.get_bin_variance(n);
+        }
+        // (With normalized sums of N_SUM > 1 components the modes reduce
+        // the variance of the bins only a little.)
+        std::cout << "      variance / independent = "
+            << variance / independent_variance << std::endl;
+    }
+    sampler.set_sampling_mode(SamplingMode::independent);
+}
+
+// With one component and the identity, stratified and Latin-hypercube
+// tuples fill every bin exactly evenly, and the batch variance says so.
+void test_exact_strata() {
+    std::cout << "block exact strata ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 64;
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        points[n] = Float(n+1) / Float{N_BINS};
+    }
+    ProbabilitySampler<true, Float, 1, N_BINS, XoshiroBlockRNG<Float>>
+        sampler{PiecewiseLinearFunction<Float, N_BINS>(points)};
+    sampler.set_seed(3);
+    sampler.set_batch_variance(true);
+    sampler.set_stopping_rule(FixedCount(N_BINS * 1024 * 16));
+    for (auto mode : {SamplingMode::stratified,
+            SamplingMode::latin_hypercube}) {
+        sampler.set_sampling_mode(mode);
+        auto pdf = sampler.generate();
+        CHECK((pdf.min_count() == 1024 * 16 && pdf.max_count() == 1024 * 16),
+                "every bin holds count / N_BINS");
+        CHECK((pdf.n_batches() == 64), "one batch per chunk");
+        Float variance = 0;
+        for (auto v : pdf.get_all_bin_variances()) {
+            variance += v;
+        }
+        CHECK((variance < 1e-6), "batch variance zero");
+    }
+}
+
+// 2^21 bins of 64-bit counters (16 MB) filled through the public API, with
+// the PDFs on the heap
+void test_large_histogram() {
+    std::cout << "block large histogram ------------------------" << std::endl;
+    using Float = double;
+    constexpr std::size_t N_BINS = std::size_t(1) << 21;
+    auto identity = [](Float const x) { return x; };
+    using Sampler = ProbabilitySampler<true, Float, 2, N_BINS,
+          XoshiroBlockRNG<Float>, std::uint64_t, ShardedHistogram,
+          decltype(identity)>;
+    Sampler sampler(identity);
+    sampler.set_seed(5);
+    sampler.set_stopping_rule(FixedCount(1 << 22));
+    auto serial = std::make_unique<Sampler::PDF>();
+    sampler.generate(*serial);
+    CHECK((serial->count() == (1 << 22)), "count == N_ITER");
+    auto parallel = std::make_unique<Sampler::PDF>();
+    sampler.set_threads(2);
+    sampler.generate(*parallel);
+    CHECK((parallel->get_all_bins() == serial->get_all_bins()),
+            "bins independent of threads");
+}
+
+// A closed-form inverse CDF samples like the table of the same function
+template <bool deposit_all>
+void test_closed_form() {
+    std::cout << "block closed form deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Float = double;
+    using RNG = XoshiroBlockRNG<Float>;
+    constexpr int N_BINS = 64;
+    constexpr int N_SUM = 3;
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        points[n] = Float(n+1) / Float{N_BINS};
+    }
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG>
+        table{PiecewiseLinearFunction<Float, N_BINS>(points)};
+    auto identity = [](Float const x) { return x; };
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG, std::uint64_t,
+        ShardedHistogram, decltype(identity)> analytic(identity);
+    ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS, RNG, std::uint64_t,
+        ShardedHistogram, Polynomial<Float, 2>>
+            polynomial(Polynomial<Float, 2>({0, 1}));
+    table.set_seed(7);
+    analytic.set_seed(7);
+    polynomial.set_seed(7);
+    auto expected = table.generate();
+    auto pdf = analytic.generate();
+    CHECK((pdf.count() == expected.count()), "same count as the table");
+    std::uint64_t moved = 0;
+    for (int b = 0; b < N_BINS; b++) {
+        auto diff = std::max(pdf.get_bin(b), expected.get_bin(b))
+            - std::min(pdf.get_bin(b), expected.get_bin(b));
+        moved += diff;
+    }
+    // (the table's interpolation may round a value across a bin edge)
+    CHECK((moved * 100000 < pdf.count()), "bins match the table");
+    CHECK((polynomial.generate().get_all_bins() == pdf.get_all_bins()),
+            "polynomial identity matches");
+
+    analytic.set_threads(3);
+    CHECK((analytic.generate().get_all_bins() == pdf.get_all_bins()),
+            "bins independent of threads");
+}
+
+int main() {
+    test_thread_invariance<true, MersenneTwisterRNG<double>>();
+    test_thread_invariance<false, MersenneTwisterRNG<double>>();
+    test_thread_invariance<true, PhiloxRNG<double>>();
+    test_thread_invariance<false, PhiloxRNG<double>>();
+    test_thread_invariance<true, XoshiroBlockRNG<double>>();
+    test_thread_invariance<false, XoshiroBlockRNG<double>>();
+    test_counters_and_layouts<true>();
+    test_counters_and_layouts<false>();
+    test_stopping_rules<MersenneTwisterRNG<double>>();
+    test_stopping_rules<PhiloxRNG<double>>();
+    test_stopping_rules<XoshiroBlockRNG<double>>();
+    test_uniform_cache<PhiloxRNG<double>>();
+    test_uniform_cache<XoshiroBlockRNG<double>>();
+    test_replicates<true>();
+    test_replicates<false>();
+    test_gradient<true>();
+    test_gradient<false>();
+    test_edge_cases<true>();
+    test_edge_cases<false>();
+    test_nudges<float>();
+    test_nudges<double>();
+    test_sampling_modes<true>();
+    test_sampling_modes<false>();
+    test_exact_strata();
+    test_closed_form<true>();
+    test_closed_form<false>();
+    test_large_histogram();
+}
@@ -0,0 +1,201 @@
+#include "RNGPolicies.hpp"
+#include "SobolRNG.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+int main() {
+    std::cout << "block 1 ------------------------" << std::endl;
+    // Known-answer tests from the Random123 distribution
+    {
+        using Block = Philox4x32::Block;
+        auto out = Philox4x32::bijection(Block{0, 0, 0, 0}, {0, 0});
+        CHECK((out == Block{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}),
+                "philox(0, 0)");
+        out = Philox4x32::bijection(
+                Block{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+                {0xffffffff, 0xffffffff});
+        CHECK((out == Block{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}),
+                "philox(~0, ~0)");
+    }
+
+    std::cout << "block 2 ------------------------" << std::endl;
+    // Seeking matches stepping
+    {
+        Philox4x32 stepped(42, 7);
+        for (int n = 0; n < 1001; n++) {
+            stepped();
+        }
+        Philox4x32 jumped(42, 7);
+        jumped.discard(1001);
+        bool same = true;
+        for (int n = 0; n < 100; n++) {
+            same = same && (stepped() == jumped());
+        }
+        CHECK(same, "discard(n) == n steps");
+
+        Philox4x32 other(42, 8);
+        Philox4x32 first(42, 7);
+        CHECK((other() != first()), "streams differ");
+    }
+
+    std::cout << "block 3 ------------------------" << std::endl;
+    // Uniforms are in [0,1)
+    {
+        auto e_float = PhiloxRNG<float>::make_engine(1, 0);
+        auto e_double = PhiloxRNG<double>::make_engine(1, 0);
+        bool in_range = true;
+        for (int n = 0; n < 100000; n++) {
+            float f = PhiloxRNG<float>::uniform(e_float);
+            double d = PhiloxRNG<double>::uniform(e_double);
+            in_range = in_range && f >= 0 && f < 1 && d >= 0 && d < 1;
+        }
+        CHECK(in_range, "0 <= u < 1");
+
+        auto a = PhiloxRNG<double>::make_engine(1, 0);
+        auto b = PhiloxRNG<double>::make_engine(1, 0);
+        for (int n = 0; n < 10; n++) {
+            PhiloxRNG<double>::uniform(a);
+        }
+        PhiloxRNG<double>::skip(b, 10);
+        CHECK((PhiloxRNG<double>::uniform(a) == PhiloxRNG<double>::uniform(b)),
+                "skip(n) == n uniforms");
+    }
+
+    std::cout << "block 4 ------------------------" << std::endl;
+    // Block fill matches scalar draws (including a ragged start and end)
+    {
+        auto check_block = [](auto zero) {
+            using Float = decltype(zero);
+            using Policy = XoshiroBlockRNG<Float>;
+            auto scalar = Policy::make_engine(3, 5);
+            auto block = Policy::make_engine(3, 5);
+            std::vector<Float> expected(1003);
+            for (auto & y : expected) {
+                y = Policy::uniform(scalar);
+            }
+            std::vector<Float> actual(1003);
+            actual[0] = Policy::uniform(block);
+            actual[1] = Policy::uniform(block);
+            actual[2] = Policy::uniform(block);
+            fill_uniforms<Policy>(block, actual.data() + 3, 1000);
+            bool in_range = true;
+            for (auto & y : actual) {
+                in_range = in_range && y >= 0 && y < 1;
+            }
+            CHECK((actual == expected), "fill == uniform");
+            CHECK(in_range, "0 <= u < 1");
+        };
+        check_block(float{0});
+        check_block(double{0});
+    }
+
+    std::cout << "block 5 ------------------------" << std::endl;
+    // Scrambled Sobol points keep their stratification
+    {
+        using Policy = SobolRNG<double, 3>;
+        constexpr int M = 10;
+        constexpr int N = 1 << M;
+        auto engine = Policy::make_engine(17, 4);
+        std::vector<std::array<double, 3>> points(N);
+        bool in_range = true;
+        for (auto & p : points) {
+            for (auto & x : p) {
+                x = Policy::uniform(engine);
+                in_range = in_range && x >= 0 && x < 1;
+            }
+        }
+        CHECK(in_range, "0 <= u < 1");
+
+        // One point in each interval [k/N, (k+1)/N) of every coordinate
+        bool stratified = true;
+        for (int d = 0; d < 3; d++) {
+            std::vector<int> hits(N, 0);
+            for (auto const & p : points) {
+                hits[int(p[d] * N)]++;
+            }
+            stratified = stratified
+                && std::all_of(hits.begin(), hits.end(), [](int h) { return h == 1; });
+        }
+        CHECK(stratified, "1D stratification");
+
+        // The first two coordinates form a (0,M,2)-net: one point in every
+        // elementary box of area 1/N
+        bool net = true;
+        for (int j = 0; j <= M; j++) {
+            std::vector<int> hits(N, 0);
+            for (auto const & p : points) {
+                int a = int(p[0] * (1 << j));
+                int b = int(p[1] * (1 << (M - j)));
+                hits[(a << (M - j)) + b]++;
+            }
+            net = net
+                && std::all_of(hits.begin(), hits.end(), [](int h) { return h == 1; });
+        }
+        CHECK(net, "(0,m,2)-net");
+
+        // Seeking matches stepping, including mid-point offsets
+        auto stepped = Policy::make_engine(17, 4);
+        for (int n = 0; n < 1001; n++) {
+            Policy::uniform(stepped);
+        }
+        auto jumped = Policy::make_engine(17, 4);
+        Policy::skip(jumped, 1000);
+        Policy::skip(jumped, 1);
+        bool same = true;
+        for (int n = 0; n < 100; n++) {
+            same = same && (Policy::uniform(stepped) == Policy::uniform(jumped));
+        }
+        CHECK(same, "skip(n) == n uniforms");
+
+        auto other = Policy::make_engine(17, 5);
+        auto first = Policy::make_engine(17, 4);
+        CHECK((Policy::uniform(other) != Policy::uniform(first)),
+                "streams differ");
+    }
+    std::cout << "block 6 ------------------------" << std::endl;
+    // Every build of the xoshiro block kernel (see CPUDispatch.hpp) the CPU
+    // can run gives the same uniforms and leaves the same state
+    {
+        auto check_targets = [](auto zero) {
+            using Float = decltype(zero);
+            using Targets = cpu_dispatch_::Targets<
+                xoshiro_block_rng_::Kernel<Float>>;
+            constexpr std::size_t N_STEPS = 1001;
+            auto const start =
+                XoshiroBlockRNG<Float>::make_engine(17, 3).state;
+            std::vector<Float> expected(N_STEPS * xoshiro_block_rng_::LANES);
+            auto expected_state = start;
+            Targets::generic(expected_state, expected.data(), N_STEPS);
+            auto same_as_generic = [&](auto const kernel) {
+                std::vector<Float> out(expected.size());
+                auto state = start;
+                kernel(state, out.data(), N_STEPS);
+                return out == expected && std::equal(&state.s[0][0],
+                        &state.s[0][0] + 4 * xoshiro_block_rng_::LANES,
+                        &expected_state.s[0][0]);
+            };
+#if CPU_DISPATCH
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx2")) {
+                CHECK(same_as_generic(Targets::avx2), "avx2 == generic");
+            } else {
+                std::cout << "      : (no AVX2)" << std::endl;
+            }
+            if (__builtin_cpu_supports("avx512f")
+                    && __builtin_cpu_supports("avx512vl")) {
+                CHECK(same_as_generic(Targets::avx512), "avx512 == generic");
+            } else {
+                std::cout << "      : (no AVX-512)" << std::endl;
+            }
+#endif
+            CHECK(same_as_generic(Targets::generic), "generic repeatable");
+        };
+        check_targets(float{0});
+        check_targets(double{0});
+    }
+}
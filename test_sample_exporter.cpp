@@ -0,0 +1,126 @@
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "SampleExporter.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+template <bool deposit_all>
+void test_exporter(bool const compress) {
+    std::cout << "block deposit_all=" << deposit_all << " compress="
+        << compress << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 64;
+    constexpr int N_SUM = 3;
+    using Function = PiecewiseLinearFunction<Float, N_BINS>;
+    using Sampler = ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+          XoshiroBlockRNG<Float>>;
+    using Exporter = typename Sampler::Exporter;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * (Float{2} - x);
+    }
+    Function inverse_cdf(points);
+    Sampler sampler(inverse_cdf);
+    sampler.set_seed(99);
+    sampler.set_threads(3);
+    std::size_t n_deposits = 300001;
+    sampler.set_stopping_rule(FixedCount(n_deposits));
+    auto plain = sampler.generate();
+
+    // Same run, exported
+    std::string file = "test_sample_export.bin";
+    auto exporter = std::make_shared<Exporter>(file, compress);
+    sampler.set_exporter(exporter);
+    auto exported = sampler.generate();
+    exporter->close();
+    sampler.set_exporter(nullptr);
+    CHECK((exported.get_all_bins() == plain.get_all_bins()),
+            "exporting leaves the PDF unchanged");
+
+    // Every tuple, in order, normalized, and deposited as in the PDF
+    auto tuples = Exporter::read_all(file);
+    std::size_t n_tuples = Sampler::tuples_for(n_deposits);
+    CHECK((tuples.size() == n_tuples * N_SUM), "every tuple exported");
+    bool normalized = true;
+    typename Sampler::PDF rebuilt;
+    for (std::size_t t = 0; t < tuples.size() / N_SUM; t++) {
+        Float const * tuple = tuples.data() + t * N_SUM;
+        Float sum{0};
+        for (int i = 0; i < N_SUM; i++) {
+            normalized = normalized && tuple[i] >= Float{0}
+                && tuple[i] < Float{1};
+            sum += tuple[i];
+        }
+        normalized = normalized && std::abs(sum - Float{1}) < 1e-12;
+        rebuilt.deposit_batch(tuple, deposit_all ? N_SUM : 1);
+    }
+    CHECK(normalized, "tuples in [0,1) summing to one");
+    CHECK((rebuilt.get_all_bins() == plain.get_all_bins()),
+            "exported tuples rebuild the PDF");
+    std::remove(file.c_str());
+}
+
+void test_blocks_too_small() {
+    std::cout << "block small blocks ------------------------" << std::endl;
+    using Float = double;
+    using Sampler = ProbabilitySampler<true, Float, 2, 16,
+          XoshiroBlockRNG<Float>>;
+    std::array<Float, 15> points;
+    for (int n = 0; n < 15; n++) {
+        points[n] = Float(n+1) / Float{16};
+    }
+    Sampler sampler{PiecewiseLinearFunction<Float, 16>(points)};
+    bool thrown = false;
+    try {
+        sampler.set_exporter(std::make_shared<typename Sampler::Exporter>(
+                    "test_sample_export_small.bin", false, 16));
+    } catch (std::invalid_argument const &) {
+        thrown = true;
+    }
+    CHECK(thrown, "exporter with blocks smaller than the sampler's rejected");
+    std::remove("test_sample_export_small.bin");
+}
+
+// A failed write is thrown by close(), and dropped by the destructor
+// (which must not throw)
+void test_write_error() {
+    std::cout << "block write error ------------------------" << std::endl;
+    using Exporter = SampleExporter<double, 2>;
+    bool thrown = false;
+    try {
+        Exporter exporter("/dev/full");
+        exporter.close();
+    } catch (std::system_error const &) {
+        thrown = true;
+    }
+    CHECK(thrown, "close() throws on a full device");
+    {
+        Exporter exporter("/dev/full");
+        auto block = exporter.acquire();
+        exporter.submit(block, 0, 1);
+    }
+    CHECK(true, "destructor drops the error");
+}
+
+int main() {
+    test_exporter<true>(false);
+    test_exporter<false>(false);
+#if SAMPLE_EXPORTER_ZLIB
+    test_exporter<true>(true);
+#endif
+    test_blocks_too_small();
+    test_write_error();
+}
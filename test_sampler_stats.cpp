@@ -0,0 +1,125 @@
+#define SAMPLER_STATS 1
+
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "SamplerStats.hpp"
+#include "ScriptedRNG.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <array>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct EdgeCases {
+    static std::vector<double> const & values() {
+        static std::vector<double> v{
+            0.0, 0.0,
+            0.0, std::nextafter(1.0, 0.0),
+            std::nextafter(1.0, 0.0), std::nextafter(1.0, 0.0),
+            0.5, 0.25};
+        return v;
+    }
+};
+
+template <std::size_t N_BINS>
+PiecewiseLinearFunction<double, N_BINS> identity() {
+    std::array<double, N_BINS-1> points;
+    for (std::size_t n = 0; n < N_BINS-1; n++) {
+        points[n] = double(n+1) / double(N_BINS);
+    }
+    return PiecewiseLinearFunction<double, N_BINS>(points);
+}
+
+template <bool deposit_all>
+void test_counts() {
+    std::cout << "block counts deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Sampler = ProbabilitySampler<deposit_all, double, 3, 64,
+          XoshiroBlockRNG<double>>;
+    Sampler sampler(identity<64>());
+    sampler.set_seed(5);
+    sampler.set_threads(3);
+    std::size_t n_deposits = 500001;
+    sampler.set_stopping_rule(RelativeError(0.02, 1 << 15));
+    auto pdf = sampler.generate();
+    auto const & stats = sampler.stats();
+
+    CHECK(stats.enabled, "enabled with SAMPLER_STATS");
+    CHECK((stats.deposits == pdf.count()), "deposits == PDF count");
+    CHECK((stats.tuples * (deposit_all ? 3 : 1) == stats.deposits),
+            "deposits == tuples per deposit mode");
+    std::uint64_t thread_tuples = 0;
+    for (auto const & t : stats.threads) {
+        thread_tuples += t.tuples;
+    }
+    CHECK((thread_tuples == stats.tuples), "per-thread tuples add up");
+    // (rounds too small to split may use fewer threads)
+    CHECK((stats.threads.size() >= 1 && stats.threads.size() <= 3),
+            "one entry per thread");
+
+    // The rule was consulted once per round, the last time saying stop
+    CHECK((stats.rounds.size() >= 2), "several rounds");
+    CHECK((stats.rounds.back().deposits_requested == 0), "last round stops");
+    CHECK((stats.rounds.back().tuples == stats.tuples),
+            "last round saw every tuple");
+    bool increasing = true;
+    for (std::size_t r = 1; r < stats.rounds.size(); r++) {
+        increasing = increasing
+            && stats.rounds[r].tuples > stats.rounds[r-1].tuples
+            && stats.rounds[r].seconds >= stats.rounds[r-1].seconds;
+    }
+    CHECK(increasing, "rounds in order");
+
+    double phases = stats.draw_seconds + stats.inverse_cdf_seconds
+        + stats.normalize_seconds + stats.deposit_seconds;
+    CHECK((stats.draw_seconds > 0 && stats.inverse_cdf_seconds > 0
+                && stats.normalize_seconds > 0 && stats.deposit_seconds > 0),
+            "every phase timed");
+    CHECK((phases <= 3 * stats.seconds * 1.01), "phases within the run time");
+    CHECK((stats.ticks_per_second > 0), "ticks calibrated");
+
+    std::string json = stats.to_json();
+    CHECK((json.front() == '{' && json.back() == '}'
+                && json.find("\"tuples\":" + std::to_string(stats.tuples))
+                    != std::string::npos
+                && json.find("\"rounds\":[") != std::string::npos),
+            "JSON holds the counts");
+
+    // A fixed-count run: one round to sample, one to stop
+    sampler.set_stopping_rule(FixedCount(n_deposits));
+    sampler.generate();
+    CHECK((sampler.stats().rounds.size() == 2), "fixed count: two rounds");
+    CHECK((sampler.stats().deposits == Sampler::tuples_for(n_deposits)
+                * (deposit_all ? 3 : 1)), "stats reset per run");
+}
+
+void test_edge_cases() {
+    std::cout << "block edge cases ------------------------" << std::endl;
+    using Sampler = ProbabilitySampler<true, double, 2, 8,
+          ScriptedRNG<double, EdgeCases>>;
+    Sampler sampler(identity<8>());
+    sampler.set_stopping_rule(FixedCount(100000));
+    sampler.generate();
+
+    // Per cycle of four tuples: three zero draws, and (0, 1-) normalizes
+    // its second value to one
+    std::uint64_t n_tuples = Sampler::tuples_for(100000);
+    std::uint64_t zero_draws = 0;
+    std::uint64_t unit_values = 0;
+    for (std::uint64_t t = 0; t < n_tuples; t++) {
+        zero_draws += t % 4 == 0 ? 2 : t % 4 == 1 ? 1 : 0;
+        unit_values += t % 4 == 1 ? 1 : 0;
+    }
+    CHECK((sampler.stats().zero_draws == zero_draws), "zero draws counted");
+    CHECK((sampler.stats().unit_values == unit_values), "unit values counted");
+}
+
+int main() {
+    test_counts<true>();
+    test_counts<false>();
+    test_edge_cases();
+}
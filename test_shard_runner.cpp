@@ -0,0 +1,101 @@
+#include "PDFCheckpoint.hpp"
+#include "PiecewiseLinearFunction.hpp"
+#include "ProbabilitySampler.hpp"
+#include "ShardRunner.hpp"
+#include "XoshiroBlockRNG.hpp"
+
+#include "check_macro.hpp"
+
+#include <array>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+template <bool deposit_all>
+void test_runner() {
+    std::cout << "block deposit_all=" << deposit_all
+        << " ------------------------" << std::endl;
+    using Float = double;
+    constexpr int N_BINS = 64;
+    constexpr int N_SUM = 3;
+    using Function = PiecewiseLinearFunction<Float, N_BINS>;
+    using Sampler = ProbabilitySampler<deposit_all, Float, N_SUM, N_BINS,
+          XoshiroBlockRNG<Float>>;
+
+    std::array<Float, N_BINS-1> points;
+    for (int n = 0; n < N_BINS-1; n++) {
+        Float x = Float(n+1) / Float{N_BINS};
+        points[n] = x * (Float{2} - x);
+    }
+    Function inverse_cdf(points);
+    Sampler sampler(inverse_cdf);
+    sampler.set_seed(4242);
+    std::size_t n_deposits = 1000003;
+    sampler.set_stopping_rule(FixedCount(n_deposits));
+    auto serial = sampler.generate();
+
+    // The parts tile the run
+    std::size_t n_tuples = Sampler::tuples_for(n_deposits);
+    bool tiled = true;
+    std::size_t next = 0;
+    for (std::size_t p = 0; p < 5; p++) {
+        auto range = ShardRunner<Sampler>::part(p, 5, n_tuples);
+        tiled = tiled && range[0] == next
+            && range[0] % Sampler::chunk_tuples() == 0;
+        next = range[1];
+    }
+    CHECK((tiled && next == n_tuples), "parts tile the run on chunk boundaries");
+
+    for (std::size_t n_processes : {1, 3, 8}) {
+        ShardRunner<Sampler> runner(n_processes);
+        auto pdf = runner.run(sampler, n_deposits);
+        CHECK((pdf.count() == serial.count()), "count == generate() count");
+        CHECK((pdf.get_all_bins() == serial.get_all_bins()),
+                "bins == generate() bins");
+    }
+
+    // Parts run as separate jobs and merged from their checkpoint files
+    std::vector<std::string> files;
+    for (std::size_t p = 0; p < 3; p++) {
+        files.push_back("test_shard_" + std::to_string(p) + ".bin");
+        ShardRunner<Sampler>::run_part(sampler, n_deposits, p, 3, files[p]);
+    }
+    merge_checkpoints(files, "test_shard_merged.bin");
+    typename Sampler::PDF merged;
+    read_checkpoint("test_shard_merged.bin", merged);
+    CHECK((merged.get_all_bins() == serial.get_all_bins()),
+            "merged parts == generate() bins");
+    files.push_back("test_shard_merged.bin");
+    for (auto const & file : files) {
+        std::remove(file.c_str());
+    }
+}
+
+// 2^21 bins of 64-bit counters (16 MB): every PDF of the run on the heap
+void test_large_histogram() {
+    std::cout << "block large histogram ------------------------" << std::endl;
+    using Float = double;
+    constexpr std::size_t N_BINS = std::size_t(1) << 21;
+    auto identity = [](Float const x) { return x; };
+    using Sampler = ProbabilitySampler<true, Float, 2, N_BINS,
+          XoshiroBlockRNG<Float>, std::uint64_t, ShardedHistogram,
+          decltype(identity)>;
+    Sampler sampler(identity);
+    sampler.set_seed(5);
+    std::size_t n_deposits = 1 << 21;
+    sampler.set_stopping_rule(FixedCount(n_deposits));
+    auto serial = std::make_unique<Sampler::PDF>();
+    sampler.generate(*serial);
+    auto sharded = std::make_unique<Sampler::PDF>();
+    ShardRunner<Sampler>(3).run(sampler, n_deposits, *sharded);
+    CHECK((sharded->get_all_bins() == serial->get_all_bins()),
+            "sharded == serial");
+}
+
+int main() {
+    test_runner<true>();
+    test_runner<false>();
+    test_large_histogram();
+}
@@ -0,0 +1,59 @@
+#include "SweepScheduler.hpp"
+
+#include "check_macro.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+int main() {
+    using Scheduler = SweepScheduler<double, XoshiroBlockRNG<double>,
+          SizeList<2>, SizeList<64>>;
+
+    std::cout << "block 1 ------------------------" << std::endl;
+    // Parse a job list
+    std::istringstream in(
+            "# comment line\n"
+            "a 1 2 64 1000000 11 0.3 0.6 0.8   # comment\n"
+            "\n"
+            "b 0 3 40 200000 12\n"
+            "c 1 2 64 0 13\n"
+            "d 0 2 64 5000 14 0.5\n");
+    auto jobs = Scheduler::read_jobs(in);
+    CHECK((jobs.size() == 4), "four jobs");
+    CHECK((jobs[0].name == "a" && jobs[0].deposit_all && jobs[0].n_sum == 2
+                && jobs[0].n_bins == 64 && jobs[0].n_deposits == 1000000
+                && jobs[0].seed == 11 && jobs[0].points.size() == 3),
+            "fields parsed");
+    CHECK((!jobs[1].deposit_all && jobs[1].points.empty()), "no points");
+
+    std::cout << "block 2 ------------------------" << std::endl;
+    // Each job matches a stand-alone run, for any thread count and task size
+    std::vector<Scheduler::PDF> expected;
+    for (auto const & job : jobs) {
+        DynamicPiecewiseLinearFunction<double> inverse_cdf(job.n_bins, job.points);
+        Scheduler::Sampler sampler(job.deposit_all, job.n_sum, inverse_cdf);
+        sampler.set_seed(job.seed);
+        sampler.set_stopping_rule(FixedCount(job.n_deposits));
+        expected.push_back(sampler.generate());
+    }
+    for (std::size_t n_threads : {1, 3}) {
+        for (std::size_t task_chunks : {1, 4}) {
+            Scheduler scheduler(n_threads, task_chunks);
+            std::vector<int> seen(jobs.size(), 0);
+            bool match = true;
+            scheduler.run(jobs, [&](Scheduler::Result const & result) {
+                seen[result.index]++;
+                auto const & a = result.pdf.get_all_bins();
+                auto const & b = expected[result.index].get_all_bins();
+                match = match && result.job == &jobs[result.index]
+                    && result.pdf.count() == expected[result.index].count()
+                    && a == b;
+            });
+            CHECK(std::all_of(seen.begin(), seen.end(),
+                        [](int s) { return s == 1; }), "every job reported once");
+            CHECK(match, "results match stand-alone runs");
+        }
+    }
+}